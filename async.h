@@ -0,0 +1,402 @@
+// Async Network Module
+//
+// Non-blocking versions of the macros of "Dynamic Networking Module"
+// (network.h) and "Dynamic Request Module" (request.h): instead of the while
+// and delay() loops of NETWORK_SETUP, REQUEST_SETUP and REQUEST_SEND, they
+// return to the caller while waiting, so several of them (and the rest of the
+// loop) run concurrently with linear-looking code.
+//
+// Two ways of writing them, both stackless (nothing but the state of the wait
+// is kept between calls):
+// - Protothreads (any compiler): A function `bool fn(async_state &pt)` whose
+//   body is in ASYNC_BEGIN(pt) ... ASYNC_END(pt). It returns false while
+//   waiting and true once finished, and continues from the wait it stopped at
+//   on the next call (call it from loop() or a task of scheduler.h). Locals do
+//   not survive a wait (use globals, statics or arguments), there can't be a
+//   switch around a wait and only one wait per line.
+// - Coroutines (C++20, e.g. hosts or ESP32 with a recent GCC and
+//   -std=gnu++20): A function returning async_task which co_awaits the
+//   *_AWAIT() macros. It starts when called and runs until its first wait,
+//   the waits are polled by async_run() (call it from loop() or a task of
+//   scheduler.h) which resumes the coroutine once done. The frames of the
+//   coroutines are allocated with new when they are called.
+// The coroutine waits are the protothread steps below polled by async_run(),
+// so both behave the same.
+//
+// Still blocking, since the Arduino libraries offer no way around it:
+// client.connect() (NETWORK_CONNECT and the connect of an HTTP request),
+// Ethernet.begin() (DHCP) and the connect of the MQTT client.
+//
+// Define macroes below before importing the header to configure:
+// ```c
+// #define ASYNC_MAX_WAITING 8 // optional, coroutines waiting at once, the
+//                             // next ones wait blocking (default 8)
+// #define ASYNC_COROUTINES 0  // optional, 0 to leave the coroutines out
+//                             // (default 1 if the compiler supports them)
+// ```
+//
+// Uses millis() of the Arduino core. Import after network.h and request.h
+// to get their async versions.
+//
+// Defines the following for the user:
+// - async_state, ASYNC_STATE(variable_name): State of a protothread.
+// - ASYNC_BEGIN(pt), ASYNC_END(pt): Start and end of a protothread body.
+// - ASYNC_AWAIT(pt, cond): Waits until cond is true, e.g. a step below or
+//   another protothread (with its own state).
+// - ASYNC_SLEEP(pt, ms): Waits ms milliseconds.
+// - ASYNC_YIELD(pt): Lets the others run once.
+// - ASYNC_ELAPSED(pt): ms since the start of the current wait.
+// When imported after network.h (steps return true once done):
+// - NETWORK_SETUP_ASYNC(pt): NETWORK_SETUP without blocking on WiFi.
+// - NETWORK_LOOP_ASYNC(pt): NETWORK_LOOP without blocking on WiFi.
+// - NETWORK_CONNECT_ASYNC(pt, connected, client, ...): NETWORK_CONNECT that
+//   sets connected (in one step).
+// When imported after request.h:
+// - REQUEST_SETUP_ASYNC(pt, client): REQUEST_SETUP without blocking between
+//   the retries of MQTT.
+// - REQUEST_LOOP_ASYNC(pt, client): Same for REQUEST_LOOP.
+// - REQUEST_SEND_ASYNC(pt, sent, client, data): REQUEST_SEND that sets sent,
+//   without blocking on the reply of HTTP (data must outlive the step).
+// With coroutines:
+// - async_task: Return type of a coroutine.
+// - async_run(): Polls the waits and resumes the coroutines whose wait is
+//   done.
+// - co_await async_sleep(ms), co_await async_until(cond): Wait ms
+//   milliseconds or until `bool cond()` returns true.
+// - co_await NETWORK_SETUP_AWAIT(), co_await NETWORK_LOOP_AWAIT(),
+//   co_await NETWORK_CONNECT_AWAIT(client, ...),
+//   co_await REQUEST_SETUP_AWAIT(client), co_await REQUEST_LOOP_AWAIT(client),
+//   co_await REQUEST_SEND_AWAIT(client, data): The steps above, the last two
+//   evaluate to whether they connected or sent.
+//
+// Example:
+// ```c
+// #include "network.h"
+// #include "request.h"
+// #include "async.h"
+//
+// NETWORK_INIT(network);
+// REQUEST_INIT(network, request);
+//
+// #if ASYNC_COROUTINES
+// async_task report() {
+//   co_await NETWORK_SETUP_AWAIT();
+//   co_await REQUEST_SETUP_AWAIT(request);
+//   for (;;) {
+//     String data = String(analogRead(A0));
+//     if (!co_await REQUEST_SEND_AWAIT(request, data))
+//       DBG("Send failed\n");
+//     co_await async_sleep(3000);
+//   }
+// }
+//
+// void setup() { report(); }
+// void loop() { async_run(); }
+// #else
+// ASYNC_STATE(report_pt);
+// ASYNC_STATE(step_pt);
+// String data;
+// bool sent;
+//
+// bool report(async_state &pt) {
+//   ASYNC_BEGIN(pt);
+//   ASYNC_AWAIT(pt, NETWORK_SETUP_ASYNC(step_pt));
+//   ASYNC_AWAIT(pt, REQUEST_SETUP_ASYNC(step_pt, request));
+//   for (;;) {
+//     data = String(analogRead(A0));
+//     ASYNC_AWAIT(pt, REQUEST_SEND_ASYNC(step_pt, sent, request, data));
+//     ASYNC_SLEEP(pt, 3000);
+//   }
+//   ASYNC_END(pt);
+// }
+//
+// void loop() { report(report_pt); }
+// #endif // ASYNC_COROUTINES
+// ```
+
+#ifndef ASYNC_H_
+#define ASYNC_H_
+
+#include <stdint.h>
+
+// Defaults
+#ifndef ASYNC_MAX_WAITING
+#define ASYNC_MAX_WAITING 8
+#endif // ASYNC_MAX_WAITING
+
+#ifndef ASYNC_COROUTINES
+#if defined(__cpp_impl_coroutine)
+#define ASYNC_COROUTINES 1
+#else
+#define ASYNC_COROUTINES 0
+#endif // __cpp_impl_coroutine
+#endif // ASYNC_COROUTINES
+
+// Dependecies
+#if ASYNC_COROUTINES
+#include <coroutine>
+#endif // ASYNC_COROUTINES
+
+// Make DBG macro optional
+#ifndef DBG
+#define DBG(...)
+#endif // DBG
+
+// Protothreads
+struct async_state {
+  int line;       // line of the wait to continue from, 0 at the start
+  uint32_t since; // ms at the start of the current wait
+};
+
+#define ASYNC_STATE(variable_name) async_state variable_name = {0, 0}
+#define ASYNC_BEGIN(pt)                                                        \
+  switch ((pt).line) {                                                         \
+  case 0:
+#define ASYNC_END(pt)                                                          \
+  }                                                                            \
+  (pt).line = 0;                                                               \
+  return true
+// cond is checked once before returning, so a wait that is already over
+// does not cost a call
+#define ASYNC_AWAIT(pt, cond)                                                  \
+  do {                                                                         \
+    (pt).since = millis();                                                     \
+    if (!(cond)) {                                                             \
+      (pt).line = __LINE__;                                                    \
+      return false;                                                            \
+    case __LINE__:                                                             \
+      if (!(cond))                                                             \
+        return false;                                                          \
+    }                                                                          \
+  } while (0)
+#define ASYNC_ELAPSED(pt) (millis() - (pt).since)
+#define ASYNC_SLEEP(pt, ms) ASYNC_AWAIT(pt, ASYNC_ELAPSED(pt) >= (uint32_t)(ms))
+#define ASYNC_YIELD(pt)                                                        \
+  do {                                                                         \
+    (pt).line = __LINE__;                                                      \
+    return false;                                                              \
+  case __LINE__:;                                                              \
+  } while (0)
+
+// Network steps
+#ifdef NETWORK_H_
+bool async_network_setup(async_state &pt) {
+  ASYNC_BEGIN(pt);
+#if NETWORK_MODE == 0 // Ethernet
+  ASYNC_SLEEP(pt, 1000);
+  DBG("Initializing Ethernet...\n");
+  if (Ethernet.begin(_macarr) == 0)
+    Ethernet.begin(_macarr, _ip);
+  DBG("IP: ");
+  DBG(NETWORK_IP);
+  DBG("\n");
+  _mac2str(_macstr, _macarr);
+#elif NETWORK_MODE == 1 // WIFI
+  WiFi.begin(NETWORK_SSID, NETWORK_PASSWORD);
+  while (WiFi.status() != WL_CONNECTED) {
+    ASYNC_SLEEP(pt, 500);
+    DBG("Connecting to WiFi...\n");
+  }
+  DBG("Connected to the WiFi network\n");
+  DBG("IP: ");
+  DBG(NETWORK_IP);
+  DBG("\n");
+#else
+  NETWORK_SETUP();
+#endif // NETWORK_MODE
+  ASYNC_END(pt);
+}
+
+bool async_network_loop(async_state &pt) {
+#if NETWORK_MODE == 1
+  if (pt.line == 0) {
+    if (WiFi.status() == WL_CONNECTED)
+      return true;
+    DBG("Disconnected Wifi... Trying to reconnect...\n");
+  }
+  return async_network_setup(pt);
+#else
+  (void)pt;
+  NETWORK_LOOP();
+  return true;
+#endif // NETWORK_MODE
+}
+
+#define NETWORK_SETUP_ASYNC(pt) async_network_setup(pt)
+#define NETWORK_LOOP_ASYNC(pt) async_network_loop(pt)
+#define NETWORK_CONNECT_ASYNC(pt, connected, client, ...)                      \
+  ((void)(pt), (connected) = NETWORK_CONNECT(client, __VA_ARGS__), true)
+#endif // NETWORK_H_
+
+// Request steps
+#ifdef REQUEST_H_
+#if REQUEST_MODE == 0 // HTTP
+bool async_request_send(async_state &pt, NETWORK_CLIENT &client,
+                        const String &data, bool &sent) {
+  ASYNC_BEGIN(pt);
+  sent = _http_send(data, client, String(REQUEST_METHOD), String(REQUEST_URL),
+                    "/" + String(REQUEST_PATH), REQUEST_PORT,
+                    String(REQUEST_HEADERS));
+  if (sent) {
+    DBG("HTTP response:\n");
+    // Same wait for the first byte of the reply as _http_response
+    ASYNC_AWAIT(pt, client.available() != 0 ||
+                        ASYNC_ELAPSED(pt) > REQUEST_REPLY_WAIT);
+    if (client.available() == 0) {
+      DBG("Wait for network timed out\n");
+    }
+    sent = 0 != _http_read_response(client);
+  }
+  ASYNC_END(pt);
+}
+
+#define _ASYNC_CLIENT(client) (*client)
+#define REQUEST_SETUP_ASYNC(pt, client) ((void)(pt), true)
+#define REQUEST_LOOP_ASYNC(pt, client) ((void)(pt), true)
+
+#elif REQUEST_MODE == 1 // MQTT
+bool async_request_setup(async_state &pt, PubSubClient &client) {
+  ASYNC_BEGIN(pt);
+  client.setServer(REQUEST_URL, REQUEST_PORT);
+  while (!client.connected())
+    if (client.connect(REQUEST_CLIENT_ID, REQUEST_USERNAME, REQUEST_PASSWORD))
+      Serial.println("MQTT broker connected");
+    else {
+      Serial.print("failed with state ");
+      Serial.println(client.state());
+      ASYNC_SLEEP(pt, 1000);
+    }
+  ASYNC_END(pt);
+}
+
+bool async_request_loop(async_state &pt, PubSubClient &client) {
+  if (!async_request_setup(pt, client))
+    return false;
+  client.loop();
+  return true;
+}
+
+bool async_request_send(async_state &pt, PubSubClient &client,
+                        const String &data, bool &sent) {
+  (void)pt;
+  sent = client.publish(REQUEST_PATH, data.c_str());
+  DBG("Sent " + data + " to " + REQUEST_PATH + " topic on " + REQUEST_URL +
+      "\n");
+  return true;
+}
+
+#define _ASYNC_CLIENT(client) (client)
+#define REQUEST_SETUP_ASYNC(pt, client) async_request_setup(pt, client)
+#define REQUEST_LOOP_ASYNC(pt, client) async_request_loop(pt, client)
+#endif // REQUEST_MODE
+
+#define REQUEST_SEND_ASYNC(pt, sent, client, data)                             \
+  async_request_send(pt, _ASYNC_CLIENT(client), data, sent)
+#endif // REQUEST_H_
+
+// Coroutines
+#if ASYNC_COROUTINES
+struct async_task {
+  struct promise_type {
+    async_task get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() {}
+  };
+};
+
+// A wait of a suspended coroutine, polled by async_run()
+struct _async_waiter {
+  std::coroutine_handle<> handle;
+  async_state pt;
+  virtual bool step() = 0;
+};
+
+_async_waiter *_async_waiting[ASYNC_MAX_WAITING];
+
+// Awaitable running the step `bool fn(async_state &pt, bool &result)`
+template <typename F> struct _async_await : _async_waiter {
+  F fn;
+  bool result;
+
+  explicit _async_await(F f) : fn(f), result(false) { pt = {0, 0}; }
+
+  bool step() override { return fn(pt, result); }
+
+  bool await_ready() { return step(); }
+  bool await_suspend(std::coroutine_handle<> h) {
+    handle = h;
+    for (size_t i = 0; i < ASYNC_MAX_WAITING; i++)
+      if (_async_waiting[i] == NULL) {
+        _async_waiting[i] = this;
+        return true;
+      }
+    // No room, wait here
+    while (!step())
+      delay(1);
+    return false;
+  }
+  bool await_resume() { return result; }
+};
+
+template <typename F> _async_await<F> _async_make(F fn) {
+  return _async_await<F>(fn);
+}
+
+void async_run() {
+  for (size_t i = 0; i < ASYNC_MAX_WAITING; i++) {
+    _async_waiter *w = _async_waiting[i];
+    if (w == NULL || !w->step())
+      continue;
+    _async_waiting[i] = NULL;
+    w->handle.resume(); // w is gone once the coroutine continues
+  }
+}
+
+inline auto async_sleep(uint32_t ms) {
+  return _async_make([ms](async_state &pt, bool &slept) {
+    ASYNC_BEGIN(pt);
+    ASYNC_SLEEP(pt, ms);
+    slept = true;
+    ASYNC_END(pt);
+  });
+}
+
+template <typename F> auto async_until(F cond) {
+  return _async_make(
+      [cond](async_state &, bool &done) { return done = cond(); });
+}
+
+#ifdef NETWORK_H_
+#define NETWORK_SETUP_AWAIT()                                                  \
+  _async_make([](async_state &pt, bool &done) {                                \
+    return done = async_network_setup(pt);                                     \
+  })
+#define NETWORK_LOOP_AWAIT()                                                   \
+  _async_make([](async_state &pt, bool &done) {                                \
+    return done = async_network_loop(pt);                                      \
+  })
+#define NETWORK_CONNECT_AWAIT(client, ...)                                     \
+  _async_make([&](async_state &pt, bool &connected) {                          \
+    return NETWORK_CONNECT_ASYNC(pt, connected, client, __VA_ARGS__);          \
+  })
+#endif // NETWORK_H_
+
+#ifdef REQUEST_H_
+#define REQUEST_SETUP_AWAIT(client)                                            \
+  _async_make([&](async_state &pt, bool &done) {                               \
+    return done = REQUEST_SETUP_ASYNC(pt, client);                             \
+  })
+#define REQUEST_LOOP_AWAIT(client)                                             \
+  _async_make([&](async_state &pt, bool &done) {                               \
+    return done = REQUEST_LOOP_ASYNC(pt, client);                              \
+  })
+#define REQUEST_SEND_AWAIT(client, data)                                       \
+  _async_make([&](async_state &pt, bool &sent) {                               \
+    return REQUEST_SEND_ASYNC(pt, sent, client, data);                         \
+  })
+#endif // REQUEST_H_
+#endif // ASYNC_COROUTINES
+
+#endif // ASYNC_H_
@@ -0,0 +1,47 @@
+// Benchmark Helpers
+//
+// Shared by the host programs of this directory (not meant for the boards).
+// Each program is a single file built from the repository root with:
+// ```sh
+// g++ -std=c++11 -O2 -I. bench/ndarray_index.cpp -o ndarray_index
+// ./ndarray_index
+// ```
+//
+// Defines the following for the user:
+// - bench_seconds(fn): Seconds per call of fn(), called in batches until
+//   BENCH_MIN_SECONDS passed (after a warm-up call).
+// - bench_sink(x): Makes the compiler assume x is used, so the code computing
+//   it is not removed.
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <chrono>
+#include <stddef.h>
+#include <stdio.h>
+
+// Defaults
+#ifndef BENCH_MIN_SECONDS
+#define BENCH_MIN_SECONDS 0.2
+#endif // BENCH_MIN_SECONDS
+
+// Program
+template <typename T> inline void bench_sink(const T &x) {
+  __asm__ __volatile__("" : : "g"(&x) : "memory");
+}
+
+template <typename F> double bench_seconds(const F &fn) {
+  typedef std::chrono::steady_clock clock;
+  fn();
+  for (size_t calls = 1;; calls *= 2) {
+    const clock::time_point start = clock::now();
+    for (size_t i = 0; i < calls; i++)
+      fn();
+    const double elapsed =
+        std::chrono::duration<double>(clock::now() - start).count();
+    if (elapsed >= BENCH_MIN_SECONDS)
+      return elapsed / calls;
+  }
+}
+
+#endif // BENCH_H_
@@ -0,0 +1,120 @@
+// ndarray_fft.h at N = 256, 1024 and 4096
+//
+// Checks the float complex FFT, the real FFT and the q15 complex FFT against
+// a double-precision DFT of the same random samples (max absolute error, the
+// q15 results are X / N) and times them next to a direct float DFT, in
+// microseconds per transform (including the copy of the input):
+// ```sh
+// g++ -std=c++11 -O2 -I. bench/ndarray_fft.cpp -o ndarray_fft
+// ./ndarray_fft
+// ```
+
+#include "bench/bench.h"
+#include "ndarray.h"
+#include "ndarray_fixed.h"
+#include "ndarray_fft.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PI 3.14159265358979323846
+
+// Reference X[k] = sum_n x[n] e^(-2 pi i k n / N) of N (re, im) pairs
+template <size_t N> void dft(double *out, const float *x) {
+  for (size_t k = 0; k < N; k++) {
+    double re = 0, im = 0;
+    for (size_t n = 0; n < N; n++) {
+      const double a = -2 * PI * (double)((k * n) % N) / N;
+      re += x[2 * n] * cos(a) - x[2 * n + 1] * sin(a);
+      im += x[2 * n] * sin(a) + x[2 * n + 1] * cos(a);
+    }
+    out[2 * k] = re;
+    out[2 * k + 1] = im;
+  }
+}
+
+// The textbook DFT the FFT replaces, in float with the twiddles computed
+// on the fly
+template <size_t N> void direct_dft(float *out, const float *x) {
+  for (size_t k = 0; k < N; k++) {
+    float re = 0, im = 0;
+    for (size_t n = 0; n < N; n++) {
+      const float a = -2 * (float)PI * (float)((k * n) % N) / N;
+      const float c = cosf(a), s = sinf(a);
+      re += x[2 * n] * c - x[2 * n + 1] * s;
+      im += x[2 * n] * s + x[2 * n + 1] * c;
+    }
+    out[2 * k] = re;
+    out[2 * k + 1] = im;
+  }
+}
+
+template <size_t N> void run() {
+  static float x[2 * N], complex_buf[2 * N], real_buf[N], out[2 * N];
+  static double ref[2 * N], real_ref[2 * N];
+  static q15 q15_buf[2 * N];
+  for (size_t i = 0; i < 2 * N; i++)
+    x[i] = (float)rand() / RAND_MAX - 0.5f;
+  // The real FFT input is the real part of x
+  static float real_x[2 * N];
+  for (size_t n = 0; n < N; n++) {
+    real_x[2 * n] = x[2 * n];
+    real_x[2 * n + 1] = 0;
+  }
+  dft<N>(ref, x);
+  dft<N>(real_ref, real_x);
+
+  const ndarray<float, N, 2> complex(complex_buf);
+  const ndarray<float, N> real(real_buf);
+  const ndarray<q15, N, 2> fixed(q15_buf);
+  static q15 x_q15[2 * N];
+  for (size_t i = 0; i < 2 * N; i++)
+    x_q15[i] = q15(x[i]);
+  // Transforms of a fresh copy of x, so that repeated calls stay finite
+  const auto fft = [&]() {
+    memcpy(complex_buf, x, sizeof(complex_buf));
+    ndarray_fft(complex);
+  };
+  const auto rfft = [&]() {
+    for (size_t n = 0; n < N; n++)
+      real_buf[n] = x[2 * n];
+    ndarray_rfft(real);
+  };
+  const auto fixed_fft = [&]() {
+    memcpy(q15_buf, x_q15, sizeof(q15_buf));
+    ndarray_fft(fixed);
+  };
+  fft();
+  rfft();
+  fixed_fft();
+
+  double complex_error = 0, real_error = 0, fixed_error = 0;
+  for (size_t i = 0; i < 2 * N; i++) {
+    complex_error = fmax(complex_error, fabs(complex_buf[i] - ref[i]));
+    fixed_error = fmax(fixed_error, fabs(q15_buf[i].to_float() - ref[i] / N));
+  }
+  // Packed as X[0].re, X[N/2].re, then (re, im) of X[1] ... X[N/2 - 1]
+  real_error = fmax(fabs(real_buf[0] - real_ref[0]),
+                    fabs(real_buf[1] - real_ref[N]));
+  for (size_t i = 2; i < N; i++)
+    real_error = fmax(real_error, fabs(real_buf[i] - real_ref[i]));
+
+  const double t_complex = bench_seconds(fft);
+  const double t_real = bench_seconds(rfft);
+  const double t_fixed = bench_seconds(fixed_fft);
+  const double t_dft = bench_seconds([&]() {
+    direct_dft<N>(out, x);
+    bench_sink(out);
+  });
+  printf("%-6zu %8.1f %8.1f %8.1f %12.0f   %8.1e %8.1e %8.1e\n", N,
+         t_complex * 1e6, t_real * 1e6, t_fixed * 1e6, t_dft * 1e6,
+         complex_error, real_error, fixed_error);
+}
+
+int main() {
+  printf("%-6s %8s %8s %8s %12s   %8s %8s %8s\n", "N", "fft", "rfft",
+         "q15 fft", "direct DFT", "fft err", "rfft err", "q15 err");
+  run<256>();
+  run<1024>();
+  run<4096>();
+}
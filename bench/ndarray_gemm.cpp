@@ -0,0 +1,82 @@
+// ndarray_gemm.h against a naive triple loop
+//
+// Float GFLOP/s (2 n^3 flops per product) of a naive i-j-k loop and of
+// ndarray_gemm for n x n matrices from 8 x 8 to 512 x 512, with ndarray_gemv
+// (2 n^2 flops) next to them, on a single core. The products are checked to
+// match the naive loop exactly on integer-valued inputs first:
+// ```sh
+// g++ -std=c++11 -O2 -I. bench/ndarray_gemm.cpp -o ndarray_gemm
+// ./ndarray_gemm # SSE2 on x86-64
+// g++ -std=c++11 -O2 -mavx2 -mfma -I. bench/ndarray_gemm.cpp -o ndarray_gemm
+// ./ndarray_gemm # AVX2 + FMA
+// ```
+
+#include "bench/bench.h"
+#include "ndarray.h"
+#include "ndarray_gemm.h"
+#include <stdlib.h>
+#include <vector>
+
+#define NOINLINE __attribute__((noinline))
+
+NOINLINE void naive(float *c, const float *a, const float *b, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    for (size_t j = 0; j < n; j++) {
+      float sum = 0;
+      for (size_t k = 0; k < n; k++)
+        sum += a[i * n + k] * b[k * n + j];
+      c[i * n + j] = sum;
+    }
+}
+
+int main() {
+  static const size_t sizes[] = {8, 16, 32, 64, 128, 256, 512};
+  printf("%-6s %8s %8s %8s  (GFLOP/s)\n", "n", "naive", "gemm", "gemv");
+  bool ok = true;
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    std::vector<float> a(n * n), b(n * n), c(n * n), expected(n * n);
+    std::vector<float> x(n), y(n);
+    for (size_t i = 0; i < n * n; i++) {
+      a[i] = (float)(rand() % 7 - 3);
+      b[i] = (float)(rand() % 5 - 2);
+    }
+    for (size_t i = 0; i < n; i++)
+      x[i] = (float)(rand() % 5 - 2);
+    const ndarray_view<float, 2> C(c.data(), n, n);
+    const ndarray_view<const float, 2> A(a.data(), n, n), B(b.data(), n, n);
+    const ndarray_view<const float, 1> X(x.data(), n);
+    const ndarray_view<float, 1> Y(y.data(), n);
+
+    naive(expected.data(), a.data(), b.data(), n);
+    ndarray_gemm(C, A, B);
+    ndarray_gemv(Y, A, X);
+    for (size_t i = 0; i < n * n; i++)
+      ok = ok && c[i] == expected[i];
+    for (size_t i = 0; i < n; i++) {
+      float sum = 0;
+      for (size_t k = 0; k < n; k++)
+        sum += a[i * n + k] * x[k];
+      ok = ok && y[i] == sum;
+    }
+
+    const double flop = 2.0 * n * n * n;
+    const double t_naive = bench_seconds([&]() {
+      naive(c.data(), a.data(), b.data(), n);
+      bench_sink(c[0]);
+    });
+    const double t_gemm = bench_seconds([&]() {
+      ndarray_gemm(C, A, B);
+      bench_sink(c[0]);
+    });
+    const double t_gemv = bench_seconds([&]() {
+      ndarray_gemv(Y, A, X);
+      bench_sink(y[0]);
+    });
+    printf("%-6zu %8.2f %8.2f %8.2f\n", n, flop / t_naive / 1e9,
+           flop / t_gemm / 1e9, 2.0 * n * n / t_gemv / 1e9);
+  }
+  if (!ok)
+    printf("ndarray_gemm or ndarray_gemv DIFFER from the naive loop\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+// Zero overhead of ndarray.h indexing
+//
+// a(i, j, k) of an ndarray<float, 2, 3, 4> should compile to the same
+// instructions as the hand-written buf[i * 12 + j * 4 + k]. The two accessors
+// below are kept out of line so their machine code can be compared:
+// ```sh
+// g++ -std=c++11 -O2 -I. bench/ndarray_index.cpp -o ndarray_index
+// for f in ndarray_at manual_at ndarray_sum manual_sum; do
+//   objdump -d --no-show-raw-insn ndarray_index | awk -v f=$f '
+//     $0 ~ "<" f ">:" {p = 1; next} /^$/ {p = 0}
+//     p && !/nop/ {sub(/.*:\t/, ""); sub(/[0-9a-f]+ <[a-z_]+/, "<"); print}
+//   ' > $f.s
+// done
+// diff ndarray_at.s manual_at.s && diff ndarray_sum.s manual_sum.s
+// ./ndarray_index
+// ```
+// (addresses and alignment padding are stripped before comparing) and the
+// program times a full scan of a 64 x 64 x 64 array both ways.
+
+#include "bench/bench.h"
+#include "ndarray.h"
+
+#define NOINLINE __attribute__((noinline))
+
+extern "C" NOINLINE float ndarray_at(float *buf, size_t i, size_t j,
+                                     size_t k) {
+  ndarray<float, 2, 3, 4> a(buf);
+  return a(i, j, k);
+}
+
+extern "C" NOINLINE float manual_at(float *buf, size_t i, size_t j,
+                                    size_t k) {
+  return buf[i * 12 + j * 4 + k];
+}
+
+#define N 64
+
+extern "C" NOINLINE float ndarray_sum(float *buf) {
+  ndarray<float, N, N, N> a(buf);
+  float sum = 0;
+  for (size_t i = 0; i < N; i++)
+    for (size_t j = 0; j < N; j++)
+      for (size_t k = 0; k < N; k++)
+        sum += a(i, j, k);
+  return sum;
+}
+
+extern "C" NOINLINE float manual_sum(float *buf) {
+  float sum = 0;
+  for (size_t i = 0; i < N; i++)
+    for (size_t j = 0; j < N; j++)
+      for (size_t k = 0; k < N; k++)
+        sum += buf[(i * N + j) * N + k];
+  return sum;
+}
+
+static float buf[N * N * N];
+
+int main() {
+  for (size_t i = 0; i < N * N * N; i++)
+    buf[i] = (float)(i % 7);
+  const bool same = ndarray_at(buf, 1, 2, 3) == manual_at(buf, 1, 2, 3) &&
+                    ndarray_sum(buf) == manual_sum(buf);
+
+  const double t_ndarray =
+      bench_seconds([]() { bench_sink(ndarray_sum(buf)); });
+  const double t_manual =
+      bench_seconds([]() { bench_sink(manual_sum(buf)); });
+  printf("%d^3 scan: ndarray %.1f us, buf[(i * N + j) * N + k] %.1f us (%s)\n",
+         N, t_ndarray * 1e6, t_manual * 1e6, same ? "same result" : "DIFFER");
+  return same ? 0 : 1;
+}
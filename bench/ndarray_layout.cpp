@@ -0,0 +1,88 @@
+// Storage layouts of ndarray.h under a 2D stencil
+//
+// Times 3 passes of a 5-point stencil over 1024 x 1024 floats, walking the
+// image column by column (the worst order for row-major), with the image and
+// its output stored row-major, in 16 x 16 tiles and in Morton order. The same
+// stencil code serves the three through a(i, j), and the three results are
+// checked to be equal:
+// ```sh
+// g++ -std=c++11 -O2 -I. bench/ndarray_layout.cpp -o ndarray_layout
+// ./ndarray_layout
+// g++ -std=c++11 -O2 -mbmi2 -I. bench/ndarray_layout.cpp -o ndarray_layout
+// ./ndarray_layout # Morton indices with pdep
+// ```
+
+#include "bench/bench.h"
+#include "ndarray.h"
+#include <stdlib.h>
+
+#define NOINLINE __attribute__((noinline))
+#define N 1024
+#define PASSES 3
+
+typedef ndarray<float, N, N> row_major_t;
+typedef ndarray_basic<float, ndarray_tiled<16, 16>, N, N> tiled_t;
+typedef ndarray_basic<float, ndarray_morton, N, N> morton_t;
+
+template <typename A> NOINLINE void stencil(const A &out, const A &in) {
+  for (size_t j = 1; j + 1 < N; j++)
+    for (size_t i = 1; i + 1 < N; i++)
+      out(i, j) = 0.5f * in(i, j) + 0.125f * (in(i - 1, j) + in(i + 1, j) +
+                                              in(i, j - 1) + in(i, j + 1));
+}
+
+template <typename A> void fill(const A &a, const A &b) {
+  for (size_t i = 0; i < N; i++)
+    for (size_t j = 0; j < N; j++)
+      a(i, j) = b(i, j) = (float)((i * 31 + j * 17) % 101);
+}
+
+// The result is left in b
+template <typename A> void passes(const A &a, const A &b) {
+  for (size_t p = 0; p < PASSES; p++)
+    stencil(p % 2 ? a : b, p % 2 ? b : a);
+}
+
+template <typename A> double milliseconds(const A &a, const A &b) {
+  fill(a, b);
+  passes(a, b);
+  return 1e3 * bench_seconds([&]() { passes(a, b); });
+}
+
+template <typename A, typename B> bool same(const A &a, const B &b) {
+  for (size_t i = 0; i < N; i++)
+    for (size_t j = 0; j < N; j++)
+      if (a(i, j) != b(i, j))
+        return false;
+  return true;
+}
+
+int main() {
+  float *buf = (float *)malloc(sizeof(float) * 2 *
+                               (row_major_t::size + tiled_t::size +
+                                morton_t::size));
+  const row_major_t r0(buf), r1(r0.end());
+  const tiled_t t0(r1.end()), t1(t0.end());
+  const morton_t m0(t1.end()), m1(m0.end());
+
+  const double row_major = milliseconds(r0, r1);
+  const double tiled = milliseconds(t0, t1);
+  const double morton = milliseconds(m0, m1);
+  fill(r0, r1);
+  passes(r0, r1);
+  fill(t0, t1);
+  passes(t0, t1);
+  fill(m0, m1);
+  passes(m0, m1);
+  const bool ok = same(r1, t1) && same(r1, m1);
+  printf("%dx%d, %d passes, column order (ms): row-major %.1f, 16x16 tiles "
+         "%.1f, Morton %.1f (%s)\n",
+         N, N, PASSES, row_major, tiled, morton,
+#if defined(__BMI2__)
+         ok ? "pdep" : "DIFFER");
+#else
+         ok ? "software deposit" : "DIFFER");
+#endif // __BMI2__
+  free(buf);
+  return ok ? 0 : 1;
+}
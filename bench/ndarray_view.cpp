@@ -0,0 +1,63 @@
+// Runtime-shaped ndarray_view against the compile-time ndarray
+//
+// Scans a 1024 x 1024 float array in row order and in column order (a stride
+// of 1024 elements per step) through ndarray<float, 1024, 1024>, whose
+// offsets are folded at compile-time, and through an ndarray_view<float, 2>
+// whose shape is only known at runtime (read through a volatile here), which
+// multiplies the indices with its cached stride table:
+// ```sh
+// g++ -std=c++11 -O2 -I. bench/ndarray_view.cpp -o ndarray_view
+// ./ndarray_view
+// ```
+
+#include "bench/bench.h"
+#include "ndarray.h"
+
+#define NOINLINE __attribute__((noinline))
+#define N 1024
+
+static float buf[N * N];
+static volatile size_t runtime_n = N;
+
+template <typename A> NOINLINE float row_scan(const A &a, size_t n) {
+  float sum = 0;
+  for (size_t i = 0; i < n; i++)
+    for (size_t j = 0; j < n; j++)
+      sum += a(i, j);
+  return sum;
+}
+
+template <typename A> NOINLINE float column_scan(const A &a, size_t n) {
+  float sum = 0;
+  for (size_t j = 0; j < n; j++)
+    for (size_t i = 0; i < n; i++)
+      sum += a(i, j);
+  return sum;
+}
+
+int main() {
+  for (size_t i = 0; i < N * N; i++)
+    buf[i] = (float)(i % 7);
+  const ndarray<float, N, N> fixed(buf);
+  const size_t n = runtime_n;
+  const ndarray_view<float, 2> view(buf, n, n);
+  const bool same = row_scan(fixed, N) == row_scan(view, n) &&
+                    column_scan(fixed, N) == column_scan(view, n);
+
+  const double row_fixed =
+      bench_seconds([&]() { bench_sink(row_scan(fixed, N)); });
+  const double row_view =
+      bench_seconds([&]() { bench_sink(row_scan(view, n)); });
+  const double column_fixed =
+      bench_seconds([&]() { bench_sink(column_scan(fixed, N)); });
+  const double column_view =
+      bench_seconds([&]() { bench_sink(column_scan(view, n)); });
+  printf("%-14s %8s %13s\n", "ms", "ndarray", "ndarray_view");
+  printf("%-14s %8.2f %13.2f\n", "row order", row_fixed * 1e3,
+         row_view * 1e3);
+  printf("%-14s %8.2f %13.2f\n", "column order", column_fixed * 1e3,
+         column_view * 1e3);
+  if (!same)
+    printf("ndarray and ndarray_view sums DIFFER\n");
+  return same ? 0 : 1;
+}
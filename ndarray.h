@@ -0,0 +1,690 @@
+// Multi-dimensional Array Module
+//
+// Zero overhead view of a flat homogeneous C array as a multi-dimensional
+// array. The offset of an element is calculated with the formula in README.org
+// (Horner's form of it to be exact):
+//
+//   sum_{i=0}^{|D|} (I_i * prod_{j=i+1}^{|D|} D_j)
+//
+// Here D is a template parameter pack and I is the argument list of the call
+// operator, so D never exists in memory and the products are folded at
+// compile-time. For `ndarray<float, 2, 3, 4> a(buf)`, `a(i, j, k)` compiles to
+// exactly the same instructions as `buf[i * 12 + j * 4 + k]`.
+//
+// Requires C++11 (the default of Arduino cores). Does not use STL or the heap;
+// the view is a single pointer and the storage is owned by the user.
+//
+// Note that the same buffer can be viewed with as many D's as needed:
+// ```c
+// float buf[24];
+// ndarray<float, 2, 3, 4> a(buf);
+// ndarray<float, 6, 4> b(buf); // a(1, 2, 3) is b(5, 3)
+// ```
+//
+// When D is only known at runtime (e.g. the sensor count is read from a
+// config), use ndarray_view<T, |D|> instead. It calculates the strides
+// (prod_{j=i+1}^{|D|} D_j) once on construction and keeps them in a table so
+// indexing is only |D| multiply-adds:
+// ```c
+// ndarray_view<float, 2> c(buf, sensor_count, 24 / sensor_count);
+// ```
+//
+// Views can be reshaped, sliced, squeezed and unsqueezed without copying the
+// data. The offset of the first element is folded into the data pointer and
+// every axis carries its own stride, so any window or channel of a buffer is
+// again a plain ndarray_view sharing the original storage. Functions that
+// cannot produce a view without copying (e.g. reshaping a strided view) return
+// an empty view (data == NULL) instead.
+//
+// Transposing or permuting a view only swaps its strides, so walking the result
+// in index order would jump around the memory (thrashing the cache on hosts
+// and the flash cache on MCUs). ndarray_for_each and ndarray_copy do not walk
+// in index order; they nest the loops by decreasing stride so the innermost
+// loop is always the one closest to contiguous.
+//
+// The README formula is the row-major layout. For 2D/3D neighbourhood accesses
+// (stencils, image tiles) the same a(i, j, ...) calls can be served by a
+// layout keeping neighbours closer in memory, picked by a template parameter:
+// ```c
+// typedef ndarray_basic<float, ndarray_tiled<8, 8>, 100, 100> image_t;
+// float image_buf[image_t::size]; // padded to 104 x 104
+// image_t image(image_buf);
+// ```
+// Only the row-major layout has strides, so only it converts to ndarray_view.
+//
+// Defines the following for the user:
+// - ndarray_basic<T, Layout, D...>: View of a T* as a |D| dimensional array
+//   stored in the given layout:
+//   - ndarray_row_major: The formula in README.org.
+//   - ndarray_tiled<B...>: Tiles of B_0 x B_1 x ... elements (D padded up to
+//     multiples of B), tiles and elements within them are row-major.
+//   - ndarray_morton: Z-order curve (each D_k padded up to a power of two).
+// - ndarray<T, D...>: Alias of ndarray_basic<T, ndarray_row_major, D...>.
+//   - ndarray::rank, ndarray::size: |D| and prod(D) (compile-time constants,
+//     size includes the padding of the layout).
+//   - ndarray::dim(axis), ndarray::stride(axis): D_axis and
+//     prod_{j=axis+1}^{|D|} D_j (constexpr, stride is only for row-major).
+//   - ndarray::offset(i...): Flat offset of the element at I = [i...].
+//   - a(i...): Reference to the element at I = [i...].
+//   - a[i]: Reference to the element at flat offset i.
+//   - a.begin(), a.end(): Flat pointers for range-for loops (in layout order,
+//     padding included).
+//   - a.view(): The same array as an ndarray_view<T, |D|> (row-major only).
+// - ndarray_view<T, R>: View of a T* as an R dimensional array with runtime D.
+//   - ndarray_view(data, d...): Row-major view of data with D = [d...].
+//   - ndarray_view(data, shape): Same as above, D taken from a size_t[R].
+//   - v.shape[axis], v.strides[axis]: D and the cached strides (in elements).
+//   - v.dim(axis), v.stride(axis), v.size(), v.offset(i...): Same as ndarray.
+//   - v.contiguous(): Whether the view covers a dense row-major block.
+//   - v(i...): Reference to the element at I = [i...].
+// - ndarray_reshape(v, d...): v (must be contiguous) viewed with D = [d...].
+// - ndarray_slice(v, axis, begin, end, step): Elements begin, begin + step, ...
+//   (excluding end) of the axis. step can be negative (use end = -1 to include
+//   the 0th element in that case). begin and end are clamped to the axis like
+//   Python slices (an empty range gives a length of 0), step 0 gives an empty
+//   view.
+// - ndarray_select(v, axis, i): The R - 1 dimensional sub-view at index i of
+//   the axis (e.g. a single channel).
+// - ndarray_squeeze(v, axis), ndarray_unsqueeze(v, axis): Removes/inserts an
+//   axis of length 1.
+// - ndarray_permute(v, a...): v with its axes reordered ([a...] is a
+//   permutation of [0, R), the new axis k is the old axis a_k).
+// - ndarray_transpose(v), ndarray_transpose(v, a, b): v with all its axes
+//   reversed, or with only axes a and b swapped.
+// - ndarray_for_each(v, fn): Calls fn(element) on every element of v.
+// - ndarray_for_each(a, b, fn): Calls fn(a_element, b_element) on every pair
+//   of elements with the same index (a and b must have the same shape).
+// - ndarray_copy(dst, src): Copies src into dst (must have the same shape).
+// - NDARRAY_SIZE(...): prod(D) of the given dimensions as a constant
+//   expression (usable for buffer lengths).
+// - NDARRAY_INIT(type, variable_name, ...): Defines a static buffer named
+//   variable_name##_buf with the right size and a view of it named
+//   variable_name with the given dimensions.
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+//
+// // 2 sensors, 3 axis each, 4 samples per axis
+// NDARRAY_INIT(float, samples, 2, 3, 4);
+//
+// void loop() {
+//   for (size_t s = 0; s < samples.dim(0); s++)
+//     for (size_t a = 0; a < samples.dim(1); a++)
+//       for (size_t t = 0; t < samples.dim(2); t++)
+//         samples(s, a, t) = analogRead(s) * 1.0f;
+//
+//   Serial.println(samples(1, 2, 3)); // same as samples_buf[23]
+//   delay(3000);
+// }
+// ```
+
+#ifndef NDARRAY_H_
+#define NDARRAY_H_
+
+#include <stddef.h>
+#if defined(__BMI2__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif // __BMI2__
+
+// Helpers
+// prod(D...) at compile-time
+template <size_t... D> struct _nd_prod {
+  static constexpr size_t value = 1;
+};
+template <size_t D0, size_t... D> struct _nd_prod<D0, D...> {
+  static constexpr size_t value = D0 * _nd_prod<D...>::value;
+};
+
+// The README formula in Horner's form: ((I_0 * D_1 + I_1) * D_2 + I_2) ...
+// `acc` is the offset of the indices consumed so far (multiplying it by D_0 on
+// the first step is harmless since it starts at 0).
+template <size_t... D> struct _nd_offset {
+  static constexpr size_t at(size_t acc) { return acc; }
+};
+template <size_t D0, size_t... D> struct _nd_offset<D0, D...> {
+  template <typename... I>
+  static constexpr size_t at(size_t acc, size_t i0, I... i) {
+    return _nd_offset<D...>::at(acc * D0 + i0, i...);
+  }
+};
+
+// D_axis and prod_{j=axis+1}^{|D|} D_j of a runtime (or constexpr) axis
+template <size_t... D> struct _nd_dims {
+  static constexpr size_t dim(size_t) { return 0; }
+  static constexpr size_t stride(size_t) { return 1; }
+};
+template <size_t D0, size_t... D> struct _nd_dims<D0, D...> {
+  static constexpr size_t dim(size_t axis) {
+    return axis == 0 ? D0 : _nd_dims<D...>::dim(axis - 1);
+  }
+  static constexpr size_t stride(size_t axis) {
+    return axis == 0 ? _nd_prod<D...>::value : _nd_dims<D...>::stride(axis - 1);
+  }
+};
+
+// Keeps T out of template argument deduction (so views of T convert to views
+// of const T when passed as arguments)
+template <typename T> struct _nd_id {
+  typedef T type;
+};
+
+template <typename T> struct _nd_unconst {
+  typedef T type;
+};
+template <typename T> struct _nd_unconst<const T> {
+  typedef T type;
+};
+
+// 0, 1, ..., N - 1 as a parameter pack (std::index_sequence is C++14 and STL)
+template <size_t... I> struct _nd_seq {
+  typedef _nd_seq type;
+};
+template <typename A, typename B> struct _nd_seq_cat;
+template <size_t... A, size_t... B>
+struct _nd_seq_cat<_nd_seq<A...>, _nd_seq<B...> > {
+  typedef _nd_seq<A..., (sizeof...(A) + B)...> type;
+};
+template <size_t N>
+struct _nd_make_seq
+    : _nd_seq_cat<typename _nd_make_seq<N / 2>::type,
+                  typename _nd_make_seq<N - N / 2>::type> {};
+template <> struct _nd_make_seq<0> : _nd_seq<> {};
+template <> struct _nd_make_seq<1> : _nd_seq<0> {};
+
+constexpr size_t _nd_sum() { return 0; }
+template <typename... S> constexpr size_t _nd_sum(size_t s0, S... s) {
+  return s0 + _nd_sum(s...);
+}
+
+// ceil(log2(n)) and the index of the lowest set bit
+constexpr size_t _nd_log2_ceil(size_t n) {
+  return n <= 1 ? 0 : 1 + _nd_log2_ceil((n + 1) / 2);
+}
+constexpr size_t _nd_ctz(size_t n) { return n & 1 ? 0 : 1 + _nd_ctz(n >> 1); }
+
+// Scatters the low bits of i to the set bits of Mask (software pdep)
+template <size_t Mask> struct _nd_deposit {
+  static constexpr size_t at(size_t i) {
+    return ((i & 1) << _nd_ctz(Mask)) |
+           _nd_deposit<(Mask & (Mask - 1))>::at(i >> 1);
+  }
+};
+template <> struct _nd_deposit<0> {
+  static constexpr size_t at(size_t) { return 0; }
+};
+
+// Bit positions of a Morton code of |B| indices with B_k bits each. Bits are
+// interleaved from the least significant one, the last index first; once an
+// index runs out of bits the others take its place.
+template <size_t... B> struct _nd_morton {
+  static constexpr size_t total = _nd_sum(B...);
+  // Number of indices from `from` onwards with more than l bits
+  static constexpr size_t longer(size_t l, size_t from) {
+    return from >= sizeof...(B)
+               ? 0
+               : (_nd_dims<B...>::dim(from) > l) + longer(l, from + 1);
+  }
+  // Number of output bits before the interleaving level l
+  static constexpr size_t below(size_t l) {
+    return l == 0 ? 0 : below(l - 1) + longer(l - 1, 0);
+  }
+  static constexpr size_t mask(size_t k, size_t j = 0) {
+    return j >= _nd_dims<B...>::dim(k)
+               ? 0
+               : ((size_t)1 << (below(j) + longer(j, k + 1))) | mask(k, j + 1);
+  }
+};
+
+// sum_k(S_k * I_k) over a runtime stride table, unrolled at compile-time
+template <size_t K> constexpr ptrdiff_t _nd_dot(const ptrdiff_t *) {
+  return 0;
+}
+template <size_t K, typename... I>
+constexpr ptrdiff_t _nd_dot(const ptrdiff_t *strides, size_t i0, I... i) {
+  return strides[K] * (ptrdiff_t)i0 + _nd_dot<K + 1>(strides, i...);
+}
+
+// Fills strides with the row-major strides of shape
+inline void _nd_row_major(const size_t *shape, ptrdiff_t *strides,
+                          size_t rank) {
+  ptrdiff_t stride = 1;
+  for (size_t axis = rank; axis-- > 0;) {
+    strides[axis] = stride;
+    stride *= (ptrdiff_t)shape[axis];
+  }
+}
+
+// Nested loops over R axes, the innermost one calls fn
+template <size_t K, size_t R> struct _nd_loop {
+  template <typename T, typename F>
+  static void run(T *p, const size_t *shape, const ptrdiff_t *strides, F &fn) {
+    for (size_t i = 0; i < shape[K]; i++, p += strides[K])
+      _nd_loop<K + 1, R>::run(p, shape, strides, fn);
+  }
+  template <typename T, typename U, typename F>
+  static void run(T *p, U *q, const size_t *shape, const ptrdiff_t *p_strides,
+                  const ptrdiff_t *q_strides, F &fn) {
+    for (size_t i = 0; i < shape[K]; i++, p += p_strides[K], q += q_strides[K])
+      _nd_loop<K + 1, R>::run(p, q, shape, p_strides, q_strides, fn);
+  }
+};
+template <size_t R> struct _nd_loop<R, R> {
+  template <typename T, typename F>
+  static void run(T *p, const size_t *, const ptrdiff_t *, F &fn) {
+    fn(*p);
+  }
+  template <typename T, typename U, typename F>
+  static void run(T *p, U *q, const size_t *, const ptrdiff_t *,
+                  const ptrdiff_t *, F &fn) {
+    fn(*p, *q);
+  }
+};
+
+// Program
+template <typename T, size_t R> struct ndarray_view {
+  static_assert(R > 0, "ndarray_view needs at least one dimension");
+
+  static constexpr size_t rank = R;
+
+  T *data;
+  size_t shape[R];
+  ptrdiff_t strides[R];
+
+  ndarray_view() : data(NULL), shape(), strides() {}
+  template <typename... S>
+  ndarray_view(T *data, size_t d0, S... d)
+      : data(data), shape{d0, (size_t)d...} {
+    static_assert(sizeof...(S) + 1 == R,
+                  "ndarray_view dimension count must match its rank");
+    _nd_row_major(shape, strides, R);
+  }
+  ndarray_view(T *data, const size_t (&shape)[R]) : data(data) {
+    for (size_t axis = 0; axis < R; axis++)
+      this->shape[axis] = shape[axis];
+    _nd_row_major(this->shape, strides, R);
+  }
+  // Allows passing a view of T where a view of const T is expected
+  template <typename U>
+  ndarray_view(const ndarray_view<U, R> &other) : data(other.data) {
+    for (size_t axis = 0; axis < R; axis++) {
+      shape[axis] = other.shape[axis];
+      strides[axis] = other.strides[axis];
+    }
+  }
+
+  size_t dim(size_t axis) const { return shape[axis]; }
+  ptrdiff_t stride(size_t axis) const { return strides[axis]; }
+  size_t size() const {
+    size_t n = 1;
+    for (size_t axis = 0; axis < R; axis++)
+      n *= shape[axis];
+    return n;
+  }
+  bool contiguous() const {
+    ptrdiff_t stride = 1;
+    for (size_t axis = R; axis-- > 0;) {
+      if (shape[axis] != 1 && strides[axis] != stride)
+        return false;
+      stride *= (ptrdiff_t)shape[axis];
+    }
+    return true;
+  }
+
+  template <typename... I> ptrdiff_t offset(I... i) const {
+    static_assert(sizeof...(I) == R,
+                  "ndarray_view index count must match its rank");
+    return _nd_dot<0>(strides, i...);
+  }
+
+  template <typename... I> T &operator()(I... i) const {
+    return data[offset(i...)];
+  }
+};
+
+template <typename T, size_t R> constexpr size_t ndarray_view<T, R>::rank;
+
+// Views
+template <typename T, size_t R, typename... S>
+ndarray_view<T, sizeof...(S)> ndarray_reshape(const ndarray_view<T, R> &v,
+                                              S... d) {
+  ndarray_view<T, sizeof...(S)> reshaped(v.data, (size_t)d...);
+  if (!v.contiguous() || reshaped.size() != v.size())
+    return ndarray_view<T, sizeof...(S)>();
+  return reshaped;
+}
+
+template <typename T, size_t R>
+ndarray_view<T, R> ndarray_slice(const ndarray_view<T, R> &v, size_t axis,
+                                 ptrdiff_t begin, ptrdiff_t end,
+                                 ptrdiff_t step = 1) {
+  if (step == 0)
+    return ndarray_view<T, R>();
+  // Clamped like Python slices, to [0, n] forwards and [-1, n - 1] backwards
+  const ptrdiff_t n = (ptrdiff_t)v.shape[axis];
+  const ptrdiff_t lo = step > 0 ? 0 : -1, hi = step > 0 ? n : n - 1;
+  begin = begin < lo ? lo : (begin > hi ? hi : begin);
+  end = end < lo ? lo : (end > hi ? hi : end);
+  ptrdiff_t len = 0;
+  if (step > 0 && end > begin)
+    len = (end - begin - 1) / step + 1;
+  else if (step < 0 && begin > end)
+    len = (end - begin + 1) / step + 1;
+  ndarray_view<T, R> sliced = v;
+  if (len > 0)
+    sliced.data += begin * v.strides[axis];
+  sliced.shape[axis] = (size_t)len;
+  sliced.strides[axis] *= step;
+  return sliced;
+}
+
+template <typename T, size_t R>
+ndarray_view<T, R - 1> ndarray_select(const ndarray_view<T, R> &v, size_t axis,
+                                      size_t i) {
+  static_assert(R > 1, "ndarray_select needs at least two dimensions");
+  ndarray_view<T, R - 1> selected;
+  selected.data = v.data + (ptrdiff_t)i * v.strides[axis];
+  for (size_t from = 0, to = 0; from < R; from++) {
+    if (from == axis)
+      continue;
+    selected.shape[to] = v.shape[from];
+    selected.strides[to++] = v.strides[from];
+  }
+  return selected;
+}
+
+template <typename T, size_t R>
+ndarray_view<T, R - 1> ndarray_squeeze(const ndarray_view<T, R> &v,
+                                       size_t axis) {
+  if (v.shape[axis] != 1)
+    return ndarray_view<T, R - 1>();
+  return ndarray_select(v, axis, 0);
+}
+
+template <typename T, size_t R>
+ndarray_view<T, R + 1> ndarray_unsqueeze(const ndarray_view<T, R> &v,
+                                         size_t axis) {
+  ndarray_view<T, R + 1> unsqueezed;
+  unsqueezed.data = v.data;
+  for (size_t from = 0, to = 0; to < R + 1; to++) {
+    if (to == axis) {
+      // Any stride works for a length 1 axis, this one keeps it contiguous
+      unsqueezed.shape[to] = 1;
+      unsqueezed.strides[to] =
+          from < R ? v.strides[from] * (ptrdiff_t)v.shape[from] : 1;
+      continue;
+    }
+    unsqueezed.shape[to] = v.shape[from];
+    unsqueezed.strides[to] = v.strides[from++];
+  }
+  return unsqueezed;
+}
+
+template <typename T, size_t R, typename... A>
+ndarray_view<T, R> ndarray_permute(const ndarray_view<T, R> &v, A... a) {
+  static_assert(sizeof...(A) == R, "ndarray_permute needs R axes");
+  const size_t axes[] = {(size_t)a...};
+  ndarray_view<T, R> permuted;
+  permuted.data = v.data;
+  for (size_t axis = 0; axis < R; axis++) {
+    permuted.shape[axis] = v.shape[axes[axis]];
+    permuted.strides[axis] = v.strides[axes[axis]];
+  }
+  return permuted;
+}
+
+template <typename T, size_t R>
+ndarray_view<T, R> ndarray_transpose(const ndarray_view<T, R> &v) {
+  ndarray_view<T, R> transposed;
+  transposed.data = v.data;
+  for (size_t axis = 0; axis < R; axis++) {
+    transposed.shape[axis] = v.shape[R - 1 - axis];
+    transposed.strides[axis] = v.strides[R - 1 - axis];
+  }
+  return transposed;
+}
+
+template <typename T, size_t R>
+ndarray_view<T, R> ndarray_transpose(const ndarray_view<T, R> &v, size_t a,
+                                     size_t b) {
+  ndarray_view<T, R> transposed = v;
+  transposed.shape[a] = v.shape[b];
+  transposed.strides[a] = v.strides[b];
+  transposed.shape[b] = v.shape[a];
+  transposed.strides[b] = v.strides[a];
+  return transposed;
+}
+
+// Iteration
+// Reorders the axes of v (and w along with it) by decreasing |stride| of v and
+// flips the negative strides of v so that walking the result in index order
+// walks the memory of v forward. Both views still visit the same pairs.
+template <typename T, typename U, size_t R>
+void _nd_memory_order(ndarray_view<T, R> &v, ndarray_view<U, R> &w) {
+  for (size_t axis = 0; axis < R; axis++)
+    if (v.strides[axis] < 0) {
+      const ptrdiff_t last = (ptrdiff_t)v.shape[axis] - 1;
+      if (last < 0)
+        continue;
+      v.data += last * v.strides[axis];
+      w.data += last * w.strides[axis];
+      v.strides[axis] = -v.strides[axis];
+      w.strides[axis] = -w.strides[axis];
+    }
+  // Insertion sort, R is tiny
+  for (size_t i = 1; i < R; i++)
+    for (size_t j = i; j > 0 && v.strides[j - 1] < v.strides[j]; j--) {
+      const size_t shape = v.shape[j];
+      const ptrdiff_t v_stride = v.strides[j], w_stride = w.strides[j];
+      v.shape[j] = w.shape[j] = v.shape[j - 1];
+      v.strides[j] = v.strides[j - 1];
+      w.strides[j] = w.strides[j - 1];
+      v.shape[j - 1] = w.shape[j - 1] = shape;
+      v.strides[j - 1] = v_stride;
+      w.strides[j - 1] = w_stride;
+    }
+}
+
+template <typename T, size_t R, typename F>
+void ndarray_for_each(const ndarray_view<T, R> &v, F fn) {
+  if (v.contiguous()) {
+    for (T *p = v.data, *end = v.data + v.size(); p != end; p++)
+      fn(*p);
+    return;
+  }
+  ndarray_view<T, R> ordered = v, unused = v;
+  _nd_memory_order(ordered, unused);
+  _nd_loop<0, R>::run(ordered.data, ordered.shape, ordered.strides, fn);
+}
+
+template <typename T, typename U, size_t R, typename F>
+void ndarray_for_each(const ndarray_view<T, R> &a, const ndarray_view<U, R> &b,
+                      F fn) {
+  if (a.contiguous() && b.contiguous()) {
+    T *p = a.data;
+    U *q = b.data;
+    for (size_t i = 0, n = a.size(); i < n; i++)
+      fn(p[i], q[i]);
+    return;
+  }
+  ndarray_view<T, R> a_ordered = a;
+  ndarray_view<U, R> b_ordered = b;
+  _nd_memory_order(a_ordered, b_ordered);
+  _nd_loop<0, R>::run(a_ordered.data, b_ordered.data, a_ordered.shape,
+                      a_ordered.strides, b_ordered.strides, fn);
+}
+
+// Calls row(n, out, out_stride, a, a_stride, b, ...) on every row of the
+// innermost axis of out (in memory order) and the matching rows of a, b and c.
+// Fully contiguous operands are a single row.
+template <typename O, typename A, typename B, typename C, size_t R,
+          typename Row>
+void _nd_rows(const ndarray_view<O, R> &out, const ndarray_view<A, R> &a,
+              const ndarray_view<B, R> &b, const ndarray_view<C, R> &c,
+              const Row &row) {
+  if (out.contiguous() && a.contiguous() && b.contiguous() &&
+      c.contiguous()) {
+    row(out.size(), out.data, 1, a.data, 1, b.data, 1, c.data, 1);
+    return;
+  }
+  // Same keys, same sort: the three copies of out end up identical
+  ndarray_view<O, R> o = out, o_b = out, o_c = out;
+  ndarray_view<A, R> va = a;
+  ndarray_view<B, R> vb = b;
+  ndarray_view<C, R> vc = c;
+  _nd_memory_order(o, va);
+  _nd_memory_order(o_b, vb);
+  _nd_memory_order(o_c, vc);
+  for (size_t axis = 0; axis < R; axis++)
+    if (o.shape[axis] == 0)
+      return;
+
+  size_t idx[R] = {0};
+  O *po = o.data;
+  A *pa = va.data;
+  B *pb = vb.data;
+  C *pc = vc.data;
+  for (;;) {
+    row(o.shape[R - 1], po, o.strides[R - 1], pa, va.strides[R - 1], pb,
+        vb.strides[R - 1], pc, vc.strides[R - 1]);
+    // Odometer over the outer axes
+    size_t axis = R - 1;
+    for (; axis-- > 0;) {
+      po += o.strides[axis];
+      pa += va.strides[axis];
+      pb += vb.strides[axis];
+      pc += vc.strides[axis];
+      if (++idx[axis] < o.shape[axis])
+        break;
+      const ptrdiff_t back = (ptrdiff_t)idx[axis];
+      po -= back * o.strides[axis];
+      pa -= back * va.strides[axis];
+      pb -= back * vb.strides[axis];
+      pc -= back * vc.strides[axis];
+      idx[axis] = 0;
+    }
+    if (axis == (size_t)-1)
+      return;
+  }
+}
+
+template <typename T, typename U> struct _nd_assign {
+  void operator()(T &dst, U &src) const { dst = src; }
+};
+
+template <typename T, typename U, size_t R>
+void ndarray_copy(const ndarray_view<T, R> &dst,
+                  const ndarray_view<U, R> &src) {
+  // Ordered by the destination since scattered stores cost more than loads
+  ndarray_for_each(dst, src, _nd_assign<T, U>());
+}
+
+// Layouts
+// A layout maps I to a flat offset. Each one defines `map<D...>` with `size`
+// (the buffer length it needs, padding included) and `offset(i...)`. Only the
+// strided ones (row-major) can be turned into an ndarray_view.
+struct ndarray_row_major {
+  static constexpr bool strided = true;
+  template <size_t... D> struct map {
+    static constexpr size_t size = _nd_prod<D...>::value;
+    static constexpr size_t stride(size_t axis) {
+      return _nd_dims<D...>::stride(axis);
+    }
+    template <typename... I> static constexpr size_t offset(I... i) {
+      return _nd_offset<D...>::at(0, i...);
+    }
+  };
+};
+
+// Row-major grid of row-major B_0 x B_1 x ... tiles. D is padded up to a
+// multiple of B. Power of two tiles turn the divisions into shifts.
+template <size_t... B> struct ndarray_tiled {
+  static constexpr bool strided = false;
+  template <size_t... D> struct map {
+    static_assert(sizeof...(B) == sizeof...(D),
+                  "ndarray_tiled needs a tile size per dimension");
+    static constexpr size_t tile = _nd_prod<B...>::value;
+    static constexpr size_t size = _nd_prod<((D + B - 1) / B)...>::value * tile;
+    template <typename... I> static constexpr size_t offset(I... i) {
+      return _nd_offset<((D + B - 1) / B)...>::at(0, (size_t)i / B...) * tile +
+             _nd_offset<B...>::at(0, (size_t)i % B...);
+    }
+  };
+};
+
+// Morton (Z-order) curve, each D_k is padded up to a power of two. Indices
+// are bit-interleaved so that neighbours in every direction stay close.
+struct ndarray_morton {
+  static constexpr bool strided = false;
+  template <size_t... D> struct map {
+    typedef _nd_morton<_nd_log2_ceil(D)...> bits;
+    static constexpr size_t size = (size_t)1 << bits::total;
+    template <typename... I> static constexpr size_t offset(I... i) {
+      return at(typename _nd_make_seq<sizeof...(D)>::type(), i...);
+    }
+    template <size_t... K, typename... I>
+    static constexpr size_t at(_nd_seq<K...>, I... i) {
+#if defined(__BMI2__) && defined(__x86_64__)
+      return _nd_sum(_pdep_u64(i, bits::mask(K))...);
+#else
+      return _nd_sum(_nd_deposit<bits::mask(K)>::at(i)...);
+#endif // __BMI2__
+    }
+  };
+};
+
+template <typename E> struct _nd_expr; // see ndarray_expr.h
+
+template <typename T, typename Layout, size_t... D> struct ndarray_basic {
+  static_assert(sizeof...(D) > 0, "ndarray needs at least one dimension");
+  typedef typename Layout::template map<D...> map;
+
+  static constexpr size_t rank = sizeof...(D);
+  static constexpr size_t size = map::size;
+
+  T *data;
+
+  constexpr explicit ndarray_basic(T *data) : data(data) {}
+
+  static constexpr size_t dim(size_t axis) { return _nd_dims<D...>::dim(axis); }
+  static constexpr size_t stride(size_t axis) { return map::stride(axis); }
+
+  template <typename... I> static constexpr size_t offset(I... i) {
+    static_assert(sizeof...(I) == sizeof...(D),
+                  "ndarray index count must match its rank");
+    return map::offset(i...);
+  }
+
+  template <typename... I> T &operator()(I... i) const {
+    return data[offset(i...)];
+  }
+  T &operator[](size_t i) const { return data[i]; }
+
+  T *begin() const { return data; }
+  T *end() const { return data + size; }
+
+  // Evaluates an expression of ndarray_expr.h into the array (assigning an
+  // ndarray still only copies the pointer)
+  template <typename E>
+  const ndarray_basic &operator=(const _nd_expr<E> &expr) const;
+
+  ndarray_view<T, sizeof...(D)> view() const {
+    static_assert(Layout::strided, "only strided layouts have a view");
+    return ndarray_view<T, sizeof...(D)>(data, D...);
+  }
+};
+
+template <typename T, typename Layout, size_t... D>
+constexpr size_t ndarray_basic<T, Layout, D...>::rank;
+template <typename T, typename Layout, size_t... D>
+constexpr size_t ndarray_basic<T, Layout, D...>::size;
+
+template <typename T, size_t... D>
+using ndarray = ndarray_basic<T, ndarray_row_major, D...>;
+
+#define NDARRAY_SIZE(...) (_nd_prod<__VA_ARGS__>::value)
+#define NDARRAY_INIT(type, variable_name, ...)                                 \
+  type variable_name##_buf[NDARRAY_SIZE(__VA_ARGS__)];                         \
+  ndarray<type, __VA_ARGS__> variable_name(variable_name##_buf)
+
+#endif // NDARRAY_H_
@@ -0,0 +1,327 @@
+// Expressions for Multi-dimensional Array Module
+//
+// Arithmetic operators over ndarrays (see ndarray.h) that build expression
+// templates instead of computing intermediate arrays. Assigning an expression
+// to an ndarray evaluates the whole expression in a single fused loop:
+// ```c
+// out = a * b + c; // one loop, out[i] = a[i] * b[i] + c[i], no temporaries
+// ```
+//
+// Shapes are broadcast with the NumPy rules: shapes are aligned to the right,
+// a missing axis counts as 1 and axes of length 1 are repeated to match the
+// other operand. Since the D's of ndarrays are compile-time constants,
+// incompatible shapes are a compile error, not a runtime one. When no operand
+// is broadcast and all of them are row-major, the loop runs over the flat
+// offsets (which the compiler can vectorize); otherwise it walks the indices of
+// the output and every operand maps them to its own layout.
+//
+// Depends on ndarray.h. Works on ndarray_basic of any layout (not on
+// ndarray_view, whose shape is only known at runtime; see ndarray_ops.h).
+//
+// Note that `out = ndarray` keeps its original meaning (copies the pointer);
+// use `ndarray_assign(out, a)` to copy the elements. out can appear in the
+// expression as long as it is not broadcast.
+//
+// Defines the following for the user:
+// - a + b, a - b, a * b, a / b, -a: Expressions of ndarrays, expressions and
+//   scalars (at least one side must be an ndarray or an expression).
+// - out = expr: Evaluates expr into the ndarray out (the broadcast shape of
+//   expr must fit out).
+// - ndarray_assign(out, expr): Same as above, expr can also be an ndarray.
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+// #include "ndarray_expr.h"
+//
+// NDARRAY_INIT(float, samples, 3, 64); // 3 axis, 64 samples
+// NDARRAY_INIT(float, gain, 3, 1);     // per axis calibration
+// NDARRAY_INIT(float, offset, 3, 1);
+// NDARRAY_INIT(float, calibrated, 3, 64);
+//
+// void loop() {
+//   // ... fill samples
+//   calibrated = samples * gain + offset; // gain/offset repeated per sample
+// }
+// ```
+
+#ifndef NDARRAY_EXPR_H_
+#define NDARRAY_EXPR_H_
+
+#include "ndarray.h"
+
+// Helpers
+template <typename A, typename B> struct _nd_same {
+  static constexpr bool value = false;
+};
+template <typename A> struct _nd_same<A, A> {
+  static constexpr bool value = true;
+};
+
+constexpr bool _nd_all() { return true; }
+template <typename... B> constexpr bool _nd_all(bool b0, B... b) {
+  return b0 && _nd_all(b...);
+}
+
+// Shapes are _nd_seq<D...>
+template <typename S> struct _nd_rank;
+template <size_t... D> struct _nd_rank<_nd_seq<D...> > {
+  static constexpr size_t value = sizeof...(D);
+};
+
+// Prepends N axes of length 1
+template <size_t N, typename S> struct _nd_pad_ones;
+template <size_t N, size_t... D>
+struct _nd_pad_ones<N, _nd_seq<D...> >
+    : _nd_pad_ones<N - 1, _nd_seq<1, D...> > {};
+template <size_t... D> struct _nd_pad_ones<0, _nd_seq<D...> > {
+  typedef _nd_seq<D...> type;
+};
+
+constexpr size_t _nd_broadcast_dim(size_t a, size_t b) {
+  return a == b || b == 1 ? a : b;
+}
+
+template <typename A, typename B> struct _nd_broadcast_aligned;
+template <size_t... A, size_t... B>
+struct _nd_broadcast_aligned<_nd_seq<A...>, _nd_seq<B...> > {
+  typedef _nd_seq<_nd_broadcast_dim(A, B)...> type;
+  static constexpr bool ok = _nd_all((A == B || A == 1 || B == 1)...);
+};
+
+// NumPy broadcasting of two shapes
+template <typename A, typename B> struct _nd_broadcast {
+  static constexpr size_t rank = _nd_rank<A>::value > _nd_rank<B>::value
+                                     ? _nd_rank<A>::value
+                                     : _nd_rank<B>::value;
+  typedef _nd_broadcast_aligned<
+      typename _nd_pad_ones<rank - _nd_rank<A>::value, A>::type,
+      typename _nd_pad_ones<rank - _nd_rank<B>::value, B>::type>
+      aligned;
+  typedef typename aligned::type type;
+  static constexpr bool ok = aligned::ok;
+};
+
+// Program
+// Every node defines:
+// - value_type, shape (_nd_seq<D...>) and rank.
+// - flat: Whether at_flat(i) is the element at the row-major offset i of
+//   shape (no broadcasting and no other layout below the node).
+// - at(idx): The element at the index idx (rank long).
+template <typename E> struct _nd_expr {
+  const E &self() const { return static_cast<const E &>(*this); }
+};
+
+template <typename T, typename Layout, size_t... D>
+struct _nd_leaf : _nd_expr<_nd_leaf<T, Layout, D...> > {
+  typedef typename _nd_unconst<T>::type value_type;
+  typedef _nd_seq<D...> shape;
+  static constexpr size_t rank = sizeof...(D);
+  static constexpr bool flat = Layout::strided;
+
+  const T *data;
+
+  explicit _nd_leaf(const ndarray_basic<T, Layout, D...> &a) : data(a.data) {}
+
+  value_type at(const size_t *idx) const {
+    return at(idx, typename _nd_make_seq<rank>::type());
+  }
+  // Broadcast axes (D_k == 1) always read index 0
+  template <size_t... K>
+  value_type at(const size_t *idx, _nd_seq<K...>) const {
+    return data[Layout::template map<D...>::offset((D == 1 ? 0 : idx[K])...)];
+  }
+  value_type at_flat(size_t i) const { return data[i]; }
+};
+
+template <typename T> struct _nd_scalar : _nd_expr<_nd_scalar<T> > {
+  typedef T value_type;
+  typedef _nd_seq<> shape;
+  static constexpr size_t rank = 0;
+  static constexpr bool flat = true;
+
+  T value;
+
+  explicit _nd_scalar(T value) : value(value) {}
+
+  value_type at(const size_t *) const { return value; }
+  value_type at_flat(size_t) const { return value; }
+};
+
+template <typename Op, typename A, typename B>
+struct _nd_binary : _nd_expr<_nd_binary<Op, A, B> > {
+  static_assert(_nd_broadcast<typename A::shape, typename B::shape>::ok,
+                "ndarray shapes are not broadcastable");
+  typedef decltype(Op::apply(typename A::value_type(),
+                             typename B::value_type())) value_type;
+  typedef typename _nd_broadcast<typename A::shape, typename B::shape>::type
+      shape;
+  static constexpr size_t rank = _nd_rank<shape>::value;
+  static constexpr bool flat =
+      A::flat && B::flat &&
+      (A::rank == 0 || _nd_same<typename A::shape, shape>::value) &&
+      (B::rank == 0 || _nd_same<typename B::shape, shape>::value);
+
+  A a;
+  B b;
+
+  _nd_binary(const A &a, const B &b) : a(a), b(b) {}
+
+  // Operands of lower rank take the trailing indices
+  value_type at(const size_t *idx) const {
+    return Op::apply(a.at(idx + (rank - A::rank)),
+                     b.at(idx + (rank - B::rank)));
+  }
+  value_type at_flat(size_t i) const {
+    return Op::apply(a.at_flat(i), b.at_flat(i));
+  }
+};
+
+template <typename A> struct _nd_negate : _nd_expr<_nd_negate<A> > {
+  typedef typename A::value_type value_type;
+  typedef typename A::shape shape;
+  static constexpr size_t rank = A::rank;
+  static constexpr bool flat = A::flat;
+
+  A a;
+
+  explicit _nd_negate(const A &a) : a(a) {}
+
+  value_type at(const size_t *idx) const { return -a.at(idx); }
+  value_type at_flat(size_t i) const { return -a.at_flat(i); }
+};
+
+#define _ND_OPERATOR_STRUCT(name, op)                                          \
+  struct name {                                                                \
+    template <typename X, typename Y>                                          \
+    static auto apply(X x, Y y) -> decltype(x op y) {                          \
+      return x op y;                                                           \
+    }                                                                          \
+  }
+_ND_OPERATOR_STRUCT(_nd_plus, +);
+_ND_OPERATOR_STRUCT(_nd_minus, -);
+_ND_OPERATOR_STRUCT(_nd_times, *);
+_ND_OPERATOR_STRUCT(_nd_divides, /);
+
+// All the combinations of expressions, ndarrays and scalars (a scalar takes the
+// value_type of the other side so deduction never mistakes an ndarray for it)
+#define _ND_OPERATOR(op, name)                                                 \
+  template <typename A, typename B>                                            \
+  _nd_binary<name, A, B> operator op(const _nd_expr<A> &a,                     \
+                                     const _nd_expr<B> &b) {                   \
+    return _nd_binary<name, A, B>(a.self(), b.self());                         \
+  }                                                                            \
+  template <typename A, typename T, typename L, size_t... D>                   \
+  _nd_binary<name, A, _nd_leaf<T, L, D...> > operator op(                      \
+      const _nd_expr<A> &a, const ndarray_basic<T, L, D...> &b) {              \
+    return _nd_binary<name, A, _nd_leaf<T, L, D...> >(                         \
+        a.self(), _nd_leaf<T, L, D...>(b));                                    \
+  }                                                                            \
+  template <typename T, typename L, size_t... D, typename B>                   \
+  _nd_binary<name, _nd_leaf<T, L, D...>, B> operator op(                       \
+      const ndarray_basic<T, L, D...> &a, const _nd_expr<B> &b) {              \
+    return _nd_binary<name, _nd_leaf<T, L, D...>, B>(_nd_leaf<T, L, D...>(a),  \
+                                                     b.self());                \
+  }                                                                            \
+  template <typename T, typename L, size_t... D, typename U, typename M,       \
+            size_t... F>                                                       \
+  _nd_binary<name, _nd_leaf<T, L, D...>, _nd_leaf<U, M, F...> > operator op(   \
+      const ndarray_basic<T, L, D...> &a, const ndarray_basic<U, M, F...> &b) {\
+    return _nd_binary<name, _nd_leaf<T, L, D...>, _nd_leaf<U, M, F...> >(      \
+        _nd_leaf<T, L, D...>(a), _nd_leaf<U, M, F...>(b));                     \
+  }                                                                            \
+  template <typename A>                                                        \
+  _nd_binary<name, A, _nd_scalar<typename A::value_type> > operator op(        \
+      const _nd_expr<A> &a, typename A::value_type b) {                        \
+    return _nd_binary<name, A, _nd_scalar<typename A::value_type> >(           \
+        a.self(), _nd_scalar<typename A::value_type>(b));                      \
+  }                                                                            \
+  template <typename A>                                                        \
+  _nd_binary<name, _nd_scalar<typename A::value_type>, A> operator op(         \
+      typename A::value_type a, const _nd_expr<A> &b) {                        \
+    return _nd_binary<name, _nd_scalar<typename A::value_type>, A>(            \
+        _nd_scalar<typename A::value_type>(a), b.self());                      \
+  }                                                                            \
+  template <typename T, typename L, size_t... D>                               \
+  _nd_binary<name, _nd_leaf<T, L, D...>,                                       \
+             _nd_scalar<typename _nd_unconst<T>::type> >                       \
+  operator op(const ndarray_basic<T, L, D...> &a,                              \
+              typename _nd_unconst<T>::type b) {                               \
+    typedef _nd_scalar<typename _nd_unconst<T>::type> scalar;                  \
+    return _nd_binary<name, _nd_leaf<T, L, D...>, scalar>(                     \
+        _nd_leaf<T, L, D...>(a), scalar(b));                                   \
+  }                                                                            \
+  template <typename T, typename L, size_t... D>                               \
+  _nd_binary<name, _nd_scalar<typename _nd_unconst<T>::type>,                  \
+             _nd_leaf<T, L, D...> >                                            \
+  operator op(typename _nd_unconst<T>::type a,                                 \
+              const ndarray_basic<T, L, D...> &b) {                            \
+    typedef _nd_scalar<typename _nd_unconst<T>::type> scalar;                  \
+    return _nd_binary<name, scalar, _nd_leaf<T, L, D...> >(                    \
+        scalar(a), _nd_leaf<T, L, D...>(b));                                   \
+  }
+_ND_OPERATOR(+, _nd_plus)
+_ND_OPERATOR(-, _nd_minus)
+_ND_OPERATOR(*, _nd_times)
+_ND_OPERATOR(/, _nd_divides)
+
+template <typename A> _nd_negate<A> operator-(const _nd_expr<A> &a) {
+  return _nd_negate<A>(a.self());
+}
+template <typename T, typename L, size_t... D>
+_nd_negate<_nd_leaf<T, L, D...> >
+operator-(const ndarray_basic<T, L, D...> &a) {
+  return _nd_negate<_nd_leaf<T, L, D...> >(_nd_leaf<T, L, D...>(a));
+}
+
+// Walks the indices of out (last axis fastest) and evaluates e at each
+template <typename T, typename Layout, size_t... D, typename E, size_t... K>
+void _nd_assign_indexed(const ndarray_basic<T, Layout, D...> &out, const E &e,
+                        _nd_seq<K...>) {
+  const size_t rank = sizeof...(D);
+  size_t idx[rank] = {0};
+  for (;;) {
+    out(idx[K]...) = e.at(idx + (rank - E::rank));
+    size_t axis = rank;
+    while (axis-- > 0) {
+      if (++idx[axis] < out.dim(axis))
+        break;
+      idx[axis] = 0;
+    }
+    if (axis == (size_t)-1)
+      return;
+  }
+}
+
+template <typename T, typename Layout, size_t... D, typename E>
+void ndarray_assign(const ndarray_basic<T, Layout, D...> &out,
+                    const _nd_expr<E> &expr) {
+  typedef _nd_broadcast<_nd_seq<D...>, typename E::shape> fit;
+  static_assert(fit::ok && _nd_same<typename fit::type, _nd_seq<D...> >::value,
+                "ndarray expression does not fit the output shape");
+  const E &e = expr.self();
+  if (Layout::strided && E::flat &&
+      _nd_same<typename E::shape, _nd_seq<D...> >::value) {
+    for (size_t i = 0; i < out.size; i++)
+      out.data[i] = e.at_flat(i);
+    return;
+  }
+  _nd_assign_indexed(out, e, typename _nd_make_seq<sizeof...(D)>::type());
+}
+
+template <typename T, typename Layout, size_t... D, typename U, typename L,
+          size_t... F>
+void ndarray_assign(const ndarray_basic<T, Layout, D...> &out,
+                    const ndarray_basic<U, L, F...> &a) {
+  ndarray_assign(out, _nd_leaf<U, L, F...>(a));
+}
+
+template <typename T, typename Layout, size_t... D>
+template <typename E>
+const ndarray_basic<T, Layout, D...> &
+ndarray_basic<T, Layout, D...>::operator=(const _nd_expr<E> &expr) const {
+  ndarray_assign(*this, expr);
+  return *this;
+}
+
+#endif // NDARRAY_EXPR_H_
@@ -0,0 +1,221 @@
+// FFT for Multi-dimensional Array Module
+//
+// In-place radix-2 FFT of a fixed (power of two) size N over ndarray views,
+// e.g. to compute vibration spectra on device and send a summary instead of
+// the raw samples. It is O(N log N) against O(N^2) for a direct DFT.
+//
+// The twiddle factors are generated at compile-time (a constexpr cosine) into
+// a table of N / 4 + 1 elements, the other three quarters of the unit circle
+// are read by symmetry. The real FFT reuses the table of its size for its
+// N / 2 point complex FFT, so the tables of both cost the same.
+//
+// A complex array of N elements is an ndarray of shape N x 2 (real and
+// imaginary parts). The real FFT of N samples packs the N / 2 + 1 bins into
+// the N samples, the real parts of X_0 and X_{N/2} (both have no imaginary
+// part) into the first two:
+//
+//     x = [Re X_0, Re X_{N/2}, Re X_1, Im X_1, ..., Re X_{N/2-1}, Im X_{N/2-1}]
+//
+// Fixed-point elements (qfixed of ndarray_fixed.h, e.g. q15) cannot hold the
+// growth of the spectrum, so each stage halves its outputs and the result is
+// X / N (as with the q15 FFTs of CMSIS-DSP). For float and double it is X.
+//
+// Depends on ndarray.h.
+//
+// Defines the following for the user:
+// - ndarray_fft(x): FFT of the complex ndarray<T, N, 2> x in place.
+// - ndarray_fft<N>(v): Same for the ndarray_view<T, 2> v, returns false (and
+//   does nothing) if v is not N x 2.
+// - ndarray_rfft(x): FFT of the real ndarray<T, N> x in place, packed as
+//   above.
+// - ndarray_rfft<N>(v): Same for the ndarray_view<T, 1> v, returns false (and
+//   does nothing) if v does not have N elements.
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+// #include "ndarray_fft.h"
+//
+// NDARRAY_INIT(float, vibration, 1024);
+//
+// void loop() {
+//   for (size_t i = 0; i < vibration.size; i++)
+//     vibration[i] = analogRead(A0);
+//   ndarray_rfft(vibration);
+//   float peak = 0;
+//   size_t peak_bin = 0;
+//   for (size_t k = 1; k < 512; k++) {
+//     const float re = vibration[2 * k], im = vibration[2 * k + 1];
+//     if (re * re + im * im > peak) {
+//       peak = re * re + im * im;
+//       peak_bin = k;
+//     }
+//   }
+//   Serial.println(peak_bin);
+// }
+// ```
+
+#ifndef NDARRAY_FFT_H_
+#define NDARRAY_FFT_H_
+
+#include "ndarray.h"
+
+// Helpers
+template <typename S, int F> struct qfixed; // ndarray_fixed.h
+
+#define _ND_PI 3.14159265358979323846
+
+// cos(x) = sum_n (-1)^n x^2n / (2n)!, exact in double for |x| <= pi / 2
+constexpr double _nd_cos_series(double x2, double term, int n) {
+  return n == 12 ? 0
+                 : term + _nd_cos_series(
+                              x2, -term * x2 / ((2 * n + 1) * (2 * n + 2)),
+                              n + 1);
+}
+constexpr double _nd_cos(double x) { return _nd_cos_series(x * x, 1, 0); }
+
+// cos(2 pi k / N) for k = 0, ..., N / 4
+template <typename T, size_t N, typename K> struct _nd_fft_quarter;
+template <typename T, size_t N, size_t... K>
+struct _nd_fft_quarter<T, N, _nd_seq<K...> > {
+  static constexpr T cos[sizeof...(K)] = {T(_nd_cos(2 * _ND_PI * K / N))...};
+};
+template <typename T, size_t N, size_t... K>
+constexpr T _nd_fft_quarter<T, N, _nd_seq<K...> >::cos[sizeof...(K)];
+
+template <typename T, size_t N>
+struct _nd_fft_table
+    : _nd_fft_quarter<T, N, typename _nd_make_seq<N / 4 + 1>::type> {
+  static_assert(N >= 2 && (N & (N - 1)) == 0,
+                "ndarray FFT size must be a power of two");
+};
+
+// w = e^(-2 pi i k / N) for k < N / 2 from the quarter table
+template <typename T>
+void _nd_twiddle(const T *cos, size_t n, size_t k, T &wr, T &wi) {
+  const size_t q = n / 4;
+  if (k <= q) {
+    wr = cos[k];
+    wi = -cos[q - k];
+  } else {
+    wr = -cos[n / 2 - k];
+    wi = -cos[k - q];
+  }
+}
+
+// Butterfly sums: (a + b) and (a - b), halved for fixed-point
+template <typename T> T _nd_fft_add(T a, T b) { return a + b; }
+template <typename T> T _nd_fft_sub(T a, T b) { return a - b; }
+template <typename S, int F>
+qfixed<S, F> _nd_fft_add(qfixed<S, F> a, qfixed<S, F> b) {
+  typedef typename qfixed<S, F>::wide W;
+  return qfixed<S, F>::from_raw((S)(((W)a.raw + b.raw) >> 1));
+}
+template <typename S, int F>
+qfixed<S, F> _nd_fft_sub(qfixed<S, F> a, qfixed<S, F> b) {
+  typedef typename qfixed<S, F>::wide W;
+  return qfixed<S, F>::from_raw((S)(((W)a.raw - b.raw) >> 1));
+}
+// (a + b) / 2 and (a - b) / 2 for every type
+template <typename T> T _nd_fft_half_add(T a, T b) { return (a + b) / 2; }
+template <typename T> T _nd_fft_half_sub(T a, T b) { return (a - b) / 2; }
+template <typename S, int F>
+qfixed<S, F> _nd_fft_half_add(qfixed<S, F> a, qfixed<S, F> b) {
+  return _nd_fft_add(a, b);
+}
+template <typename S, int F>
+qfixed<S, F> _nd_fft_half_sub(qfixed<S, F> a, qfixed<S, F> b) {
+  return _nd_fft_sub(a, b);
+}
+
+// Complex FFT of the n elements (re, im) = (p[k s0], p[k s0 + s1]) with the
+// twiddles of the table of size tn (a multiple of n)
+template <typename T>
+void _nd_fft(T *p, ptrdiff_t s0, ptrdiff_t s1, size_t n, const T *cos,
+             size_t tn) {
+  // Bit reversal permutation
+  for (size_t i = 1, j = 0; i < n; i++) {
+    size_t bit = n >> 1;
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      T *a = p + (ptrdiff_t)i * s0, *b = p + (ptrdiff_t)j * s0;
+      const T re = a[0], im = a[s1];
+      a[0] = b[0];
+      a[s1] = b[s1];
+      b[0] = re;
+      b[s1] = im;
+    }
+  }
+  // Butterflies, one twiddle per j
+  for (size_t len = 2; len <= n; len <<= 1) {
+    const size_t half = len / 2, step = tn / len;
+    for (size_t j = 0; j < half; j++) {
+      T wr, wi;
+      _nd_twiddle(cos, tn, j * step, wr, wi);
+      for (size_t i = j; i < n; i += len) {
+        T *a = p + (ptrdiff_t)i * s0, *b = a + (ptrdiff_t)half * s0;
+        const T br = b[0] * wr - b[s1] * wi, bi = b[0] * wi + b[s1] * wr;
+        const T ar = a[0], ai = a[s1];
+        a[0] = _nd_fft_add(ar, br);
+        a[s1] = _nd_fft_add(ai, bi);
+        b[0] = _nd_fft_sub(ar, br);
+        b[s1] = _nd_fft_sub(ai, bi);
+      }
+    }
+  }
+}
+
+// Real FFT of the n samples p[k s]: FFT of z_k = x_2k + i x_2k+1 and split of
+// Z_k into the FFTs of the even and odd samples E_k and O_k:
+//   E_k = (Z_k + conj Z_n/2-k) / 2,  O_k = -i (Z_k - conj Z_n/2-k) / 2
+//   X_k = E_k + w^k O_k,             X_n/2-k = conj(E_k - w^k O_k)
+template <size_t N, typename T> void _nd_rfft(T *p, ptrdiff_t s) {
+  static_assert(N >= 4, "ndarray real FFT size must be at least 4");
+  const T *cos = _nd_fft_table<T, N>::cos;
+  const size_t h = N / 2;
+  _nd_fft(p, 2 * s, s, h, cos, N);
+  const T zr = p[0], zi = p[s];
+  p[0] = _nd_fft_add(zr, zi);
+  p[s] = _nd_fft_sub(zr, zi);
+  for (size_t k = 1; k <= h / 2; k++) {
+    T *a = p + (ptrdiff_t)(2 * k) * s, *b = p + (ptrdiff_t)(2 * (h - k)) * s;
+    const T ar = a[0], ai = a[s], br = b[0], bi = -b[s];
+    const T er = _nd_fft_half_add(ar, br), ei = _nd_fft_half_add(ai, bi);
+    const T or_ = _nd_fft_half_sub(ai, bi), oi = _nd_fft_half_sub(br, ar);
+    T wr, wi;
+    _nd_twiddle(cos, N, k, wr, wi);
+    const T tr = or_ * wr - oi * wi, ti = or_ * wi + oi * wr;
+    b[0] = _nd_fft_sub(er, tr);
+    b[s] = _nd_fft_sub(ti, ei);
+    a[0] = _nd_fft_add(er, tr);
+    a[s] = _nd_fft_add(ei, ti);
+  }
+}
+
+// Program
+template <typename T, size_t N>
+void ndarray_fft(const ndarray<T, N, 2> &x) {
+  _nd_fft(x.data, 2, 1, N, _nd_fft_table<T, N>::cos, N);
+}
+
+template <size_t N, typename T> bool ndarray_fft(const ndarray_view<T, 2> &v) {
+  if (v.shape[0] != N || v.shape[1] != 2)
+    return false;
+  _nd_fft(v.data, v.strides[0], v.strides[1], N, _nd_fft_table<T, N>::cos, N);
+  return true;
+}
+
+template <typename T, size_t N> void ndarray_rfft(const ndarray<T, N> &x) {
+  _nd_rfft<N>(x.data, 1);
+}
+
+template <size_t N, typename T> bool ndarray_rfft(const ndarray_view<T, 1> &v) {
+  if (v.shape[0] != N)
+    return false;
+  _nd_rfft<N>(v.data, v.strides[0]);
+  return true;
+}
+
+#endif // NDARRAY_FFT_H_
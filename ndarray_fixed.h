@@ -0,0 +1,244 @@
+// Fixed-point Elements for Multi-dimensional Array Module
+//
+// Q-format fixed-point numbers for targets without an FPU (AVR, ESP8266),
+// where float math is emulated and an order of magnitude slower than integer
+// math. qfixed<S, F> stores x as the integer S round(x * 2^F), so the
+// arithmetic is integer adds and multiply-shifts:
+// - +, -, *, /, unary - saturate to the range of S instead of wrapping.
+// - * and / round to nearest.
+// - Comparisons compare the raw integers.
+//
+// Conversions from float/double/int are constexpr, so constants like
+// `q15(0.25f)` are folded at compile-time and cost nothing at runtime. They
+// are implicit (e.g. `x * 0.5f` works on a q15 x) which also means a runtime
+// float slipping into an expression is converted with float math; keep the
+// floats at the boundaries (sensor input, printing).
+//
+// The types are plain structs of a single integer, so they can be the element
+// type of ndarray, ndarray_view, ndarray_ops.h, ndarray_expr.h and
+// ndarray_reduce.h. ndarray_convert converts float views to and from them.
+// Contiguous q15 add/mul/scale in ndarray_ops.h use saturating SIMD (SSSE3 on
+// x86 hosts and NEON) where available.
+//
+// Depends on ndarray.h and ndarray_ops.h.
+//
+// Defines the following for the user:
+// - qfixed<S, F>: Signed fixed-point number stored in the integer type S
+//   (int8_t, int16_t or int32_t) with F fractional bits.
+//   - qfixed(x): Nearest value to the float, double or int x (saturated).
+//   - qfixed::from_raw(r): The value r * 2^-F.
+//   - q.raw: The raw integer.
+//   - q.to_float(), (float)q: The value as float.
+//   - qfixed::min(), qfixed::max(): The smallest/largest value.
+// - q7, q15, q31: qfixed<int8_t, 7>, qfixed<int16_t, 15> and
+//   qfixed<int32_t, 31>, values in [-1, 1).
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+// #include "ndarray_fixed.h"
+//
+// typedef qfixed<int16_t, 12> q4_12; // [-8, 8) with 1/4096 resolution
+//
+// NDARRAY_INIT(q4_12, samples, 3, 64);
+// NDARRAY_INIT(q4_12, calibrated, 3, 64);
+//
+// void loop() {
+//   for (size_t i = 0; i < samples.size; i++)
+//     samples[i] = q4_12::from_raw(analogRead(A0)); // 12 bit ADC as [0, 1)
+//   ndarray_scale(calibrated.view(), samples.view(), q4_12(3.3f));
+//   Serial.println(calibrated(0, 0).to_float());
+// }
+// ```
+
+#ifndef NDARRAY_FIXED_H_
+#define NDARRAY_FIXED_H_
+
+#include "ndarray.h"
+#include "ndarray_ops.h"
+#include <stdint.h>
+
+// Dependecies
+#if NDARRAY_SIMD == 1 && defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif // __SSSE3__
+
+// Helpers
+// Type wide enough for the product of two S
+template <typename S> struct _nd_fixed_wide;
+template <> struct _nd_fixed_wide<int8_t> {
+  typedef int16_t type;
+};
+template <> struct _nd_fixed_wide<int16_t> {
+  typedef int32_t type;
+};
+template <> struct _nd_fixed_wide<int32_t> {
+  typedef int64_t type;
+};
+
+constexpr float _nd_pow2f(int n) {
+  return n == 0 ? 1.0f : 2 * _nd_pow2f(n - 1);
+}
+
+// Program
+template <typename S, int F> struct qfixed {
+  static_assert(F >= 0 && F < (int)(8 * sizeof(S)),
+                "qfixed needs 0 <= F < bits of S");
+  typedef typename _nd_fixed_wide<S>::type wide;
+
+  static constexpr S max_raw = (S)(((wide)1 << (8 * sizeof(S) - 1)) - 1);
+  static constexpr S min_raw = (S)(-max_raw - 1);
+  static constexpr wide half = F > 0 ? (wide)1 << (F > 0 ? F - 1 : 0) : 0;
+
+  S raw;
+
+  qfixed() = default;
+  constexpr qfixed(float x) : raw(_from(x * _nd_pow2f(F))) {}
+  constexpr qfixed(double x) : raw(_from((float)(x * _nd_pow2f(F)))) {}
+  constexpr qfixed(int x) : raw(_sat(_clamp(x) * ((wide)1 << F))) {}
+
+  static constexpr qfixed from_raw(S r) { return qfixed(r, 0); }
+  static constexpr qfixed min() { return from_raw(min_raw); }
+  static constexpr qfixed max() { return from_raw(max_raw); }
+
+  constexpr float to_float() const { return raw / _nd_pow2f(F); }
+  constexpr explicit operator float() const { return to_float(); }
+
+  static constexpr S _sat(wide x) {
+    return x > max_raw ? max_raw : (x < min_raw ? min_raw : (S)x);
+  }
+  // Clamps an int to just outside the range so that shifting it by F fits
+  // in wide and still saturates
+  static constexpr wide _clamp(int x) {
+    return x > (max_raw >> F)
+               ? (wide)(max_raw >> F) + 1
+               : (x < (min_raw >> F) ? (wide)(min_raw >> F) : (wide)x);
+  }
+  // Rounds to nearest, out of range values (and NaN) saturate
+  static constexpr S _from(float scaled) {
+    return scaled >= (float)max_raw
+               ? max_raw
+               : (scaled >= (float)min_raw
+                      ? (S)(scaled >= 0 ? scaled + 0.5f : scaled - 0.5f)
+                      : min_raw);
+  }
+
+  friend constexpr qfixed operator+(qfixed a, qfixed b) {
+    return from_raw(_sat((wide)a.raw + b.raw));
+  }
+  friend constexpr qfixed operator-(qfixed a, qfixed b) {
+    return from_raw(_sat((wide)a.raw - b.raw));
+  }
+  friend constexpr qfixed operator-(qfixed a) {
+    return from_raw(_sat(-(wide)a.raw));
+  }
+  // Multiply-shift with rounding: (a * b + 2^(F-1)) >> F
+  friend constexpr qfixed operator*(qfixed a, qfixed b) {
+    return from_raw(_sat(((wide)a.raw * b.raw + half) >> F));
+  }
+  // (a * 2^F +- |b| / 2) / b, rounds halves away from zero
+  friend constexpr qfixed operator/(qfixed a, qfixed b) {
+    return b.raw == 0 ? (a.raw < 0 ? min() : max())
+                      : from_raw(_sat(_div((wide)a.raw * ((wide)1 << F),
+                                           (wide)b.raw)));
+  }
+  static constexpr wide _div(wide n, wide d) {
+    return (n < 0 ? n - (d < 0 ? -d : d) / 2 : n + (d < 0 ? -d : d) / 2) / d;
+  }
+
+  qfixed &operator+=(qfixed b) { return *this = *this + b; }
+  qfixed &operator-=(qfixed b) { return *this = *this - b; }
+  qfixed &operator*=(qfixed b) { return *this = *this * b; }
+  qfixed &operator/=(qfixed b) { return *this = *this / b; }
+
+  friend constexpr bool operator==(qfixed a, qfixed b) {
+    return a.raw == b.raw;
+  }
+  friend constexpr bool operator!=(qfixed a, qfixed b) {
+    return a.raw != b.raw;
+  }
+  friend constexpr bool operator<(qfixed a, qfixed b) { return a.raw < b.raw; }
+  friend constexpr bool operator>(qfixed a, qfixed b) { return a.raw > b.raw; }
+  friend constexpr bool operator<=(qfixed a, qfixed b) {
+    return a.raw <= b.raw;
+  }
+  friend constexpr bool operator>=(qfixed a, qfixed b) {
+    return a.raw >= b.raw;
+  }
+
+private:
+  constexpr qfixed(S r, int) : raw(r) {}
+};
+
+template <typename S, int F> constexpr S qfixed<S, F>::max_raw;
+template <typename S, int F> constexpr S qfixed<S, F>::min_raw;
+template <typename S, int F>
+constexpr typename qfixed<S, F>::wide qfixed<S, F>::half;
+
+typedef qfixed<int8_t, 7> q7;
+typedef qfixed<int16_t, 15> q15;
+typedef qfixed<int32_t, 31> q31;
+
+// Contiguous q15 kernels of ndarray_ops.h. vqrdmulhq_s16 and _mm_mulhrs_epi16
+// are exactly the rounding Q15 multiply; mulhrs only lacks the saturation of
+// -1 * -1 (0x8000), which is patched by flipping that lane to 0x7fff.
+#if NDARRAY_SIMD == 1 && defined(__SSSE3__)
+inline __m128i _nd_q15_mul(__m128i a, __m128i b) {
+  const __m128i r = _mm_mulhrs_epi16(a, b);
+  return _mm_xor_si128(r, _mm_cmpeq_epi16(r, _mm_set1_epi16(-32768)));
+}
+inline void _nd_add(q15 *o, const q15 *a, const q15 *b, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm_storeu_si128((__m128i *)(o + i),
+                     _mm_adds_epi16(_mm_loadu_si128((const __m128i *)(a + i)),
+                                    _mm_loadu_si128((const __m128i *)(b + i))));
+  for (; i < n; i++)
+    o[i] = a[i] + b[i];
+}
+inline void _nd_mul(q15 *o, const q15 *a, const q15 *b, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm_storeu_si128((__m128i *)(o + i),
+                     _nd_q15_mul(_mm_loadu_si128((const __m128i *)(a + i)),
+                                 _mm_loadu_si128((const __m128i *)(b + i))));
+  for (; i < n; i++)
+    o[i] = a[i] * b[i];
+}
+inline void _nd_scale(q15 *o, const q15 *a, q15 k, size_t n) {
+  const __m128i vk = _mm_set1_epi16(k.raw);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm_storeu_si128(
+        (__m128i *)(o + i),
+        _nd_q15_mul(_mm_loadu_si128((const __m128i *)(a + i)), vk));
+  for (; i < n; i++)
+    o[i] = a[i] * k;
+}
+#elif defined(_ND_NEON)
+inline void _nd_add(q15 *o, const q15 *a, const q15 *b, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    vst1q_s16(&o[i].raw,
+              vqaddq_s16(vld1q_s16(&a[i].raw), vld1q_s16(&b[i].raw)));
+  for (; i < n; i++)
+    o[i] = a[i] + b[i];
+}
+inline void _nd_mul(q15 *o, const q15 *a, const q15 *b, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    vst1q_s16(&o[i].raw,
+              vqrdmulhq_s16(vld1q_s16(&a[i].raw), vld1q_s16(&b[i].raw)));
+  for (; i < n; i++)
+    o[i] = a[i] * b[i];
+}
+inline void _nd_scale(q15 *o, const q15 *a, q15 k, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    vst1q_s16(&o[i].raw, vqrdmulhq_n_s16(vld1q_s16(&a[i].raw), k.raw));
+  for (; i < n; i++)
+    o[i] = a[i] * k;
+}
+#endif // q15 SIMD
+
+#endif // NDARRAY_FIXED_H_
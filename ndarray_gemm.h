@@ -0,0 +1,321 @@
+// Matrix Multiplication for Multi-dimensional Array Module
+//
+// GEMM (C = A B) and GEMV (y = A x) over 2D ndarray_views, e.g. for small
+// neural network layers or calibration transforms on device. Any strides
+// work, so transposed operands (ndarray_transpose) cost nothing extra.
+//
+// GEMM is blocked the usual way: a KC x NC block of B is packed into
+// contiguous panels of NR columns on the stack (so it stays in cache and is
+// read with unit stride), and a micro-kernel multiplies MR rows of A with one
+// panel keeping the MR x NR tile of C in registers. On hosts the float
+// micro-kernel uses the SIMD vectors of ndarray_ops.h (4 x 16 tile with AVX,
+// 4 x 8 with SSE2 or NEON), elsewhere it is a scalar 4 x 4 tile. GEMV uses a
+// vectorized dot product per row of a row-major A and vectorized column
+// updates (y += x_k A_k) for a column-major A.
+//
+// qfixed elements (ndarray_fixed.h) accumulate the exact products in 64 bit
+// integers and round once per output and KC block (q31 products are shifted
+// by 31 bits first to fit), instead of rounding and saturating each product.
+//
+// Define macroes below before importing the header to configure:
+// ```c
+// #define NDARRAY_GEMM_KC 128 // optional, rows of the packed block of B
+//                             // (default 128 with SIMD, 16 otherwise)
+// #define NDARRAY_GEMM_NC 128 // optional, columns of the packed block of B
+//                             // (default 128 with SIMD, 16 otherwise)
+// ```
+// The packed block is a KC x NC array of elements on the stack.
+//
+// Depends on ndarray.h and ndarray_ops.h. The output must not overlap the
+// operands.
+//
+// Defines the following for the user:
+// - ndarray_gemm(c, a, b): c = a b for the M x K a, K x N b and M x N c.
+// - ndarray_gemm(c, a, b, true): c += a b.
+// - ndarray_gemv(y, a, x): y = a x for the M x N a, N x and M y.
+// - ndarray_gemv(y, a, x, true): y += a x.
+// All return false (and do nothing) if the shapes do not match.
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+// #include "ndarray_gemm.h"
+//
+// NDARRAY_INIT(float, weights, 8, 16);
+// NDARRAY_INIT(float, features, 16);
+// NDARRAY_INIT(float, hidden, 8);
+//
+// void loop() {
+//   // ... fill features
+//   ndarray_gemv(hidden.view(), weights.view(), features.view());
+// }
+// ```
+
+#ifndef NDARRAY_GEMM_H_
+#define NDARRAY_GEMM_H_
+
+#include "ndarray.h"
+#include "ndarray_ops.h"
+#include <stdint.h>
+
+// Defaults
+#ifndef NDARRAY_GEMM_KC
+#if defined(_ND_LANES)
+#define NDARRAY_GEMM_KC 128
+#else
+#define NDARRAY_GEMM_KC 16
+#endif // _ND_LANES
+#endif // NDARRAY_GEMM_KC
+
+#ifndef NDARRAY_GEMM_NC
+#if defined(_ND_LANES)
+#define NDARRAY_GEMM_NC 128
+#else
+#define NDARRAY_GEMM_NC 16
+#endif // _ND_LANES
+#endif // NDARRAY_GEMM_NC
+
+// Helpers
+template <typename S, int F> struct qfixed; // ndarray_fixed.h
+
+// Accumulator of a sum of products of T
+template <typename T> struct _nd_dot_acc {
+  typedef T type;
+  static void mac(type &acc, T a, T b) { acc += a * b; }
+  static T out(type acc) { return acc; }
+};
+template <typename S, int F> struct _nd_dot_acc<qfixed<S, F> > {
+  typedef qfixed<S, F> T;
+  typedef int64_t type;
+  static constexpr int pre = sizeof(S) == 4 ? F : 0; // shift per product
+
+  static void mac(type &acc, T a, T b) {
+    acc += ((int64_t)a.raw * b.raw) >> pre;
+  }
+  static T out(type acc) {
+    const int shift = F - pre;
+    if (shift > 0)
+      acc = (acc + ((int64_t)1 << (shift > 0 ? shift - 1 : 0))) >> shift;
+    return T::from_raw(acc > T::max_raw ? T::max_raw
+                                        : (acc < T::min_raw ? T::min_raw
+                                                            : (S)acc));
+  }
+};
+
+// Micro-kernel tile: MR rows of A times NR columns of B
+template <typename T> struct _nd_gemm_tile {
+  static constexpr size_t mr = 4, nr = 4;
+};
+
+// t (MR x NR) = the MR rows a[r][k sa] times the packed kc x NR panel b
+template <typename T>
+void _nd_gemm_kernel(size_t kc, const T *const *a, ptrdiff_t sa, const T *b,
+                     typename _nd_dot_acc<T>::type *t) {
+  typedef _nd_dot_acc<T> Acc;
+  const size_t mr = _nd_gemm_tile<T>::mr, nr = _nd_gemm_tile<T>::nr;
+  typename Acc::type acc[mr][nr] = {};
+  for (size_t k = 0; k < kc; k++, b += nr)
+    for (size_t r = 0; r < mr; r++) {
+      const T ar = a[r][(ptrdiff_t)k * sa];
+      for (size_t j = 0; j < nr; j++)
+        Acc::mac(acc[r][j], ar, b[j]);
+    }
+  for (size_t r = 0; r < mr; r++)
+    for (size_t j = 0; j < nr; j++)
+      t[r * nr + j] = acc[r][j];
+}
+
+// Dot product of n elements of a and b
+template <typename T>
+typename _nd_dot_acc<T>::type _nd_dot_row(const T *a, ptrdiff_t sa,
+                                          const T *b, ptrdiff_t sb, size_t n) {
+  typename _nd_dot_acc<T>::type acc = 0;
+  for (size_t i = 0; i < n; i++)
+    _nd_dot_acc<T>::mac(acc, a[(ptrdiff_t)i * sa], b[(ptrdiff_t)i * sb]);
+  return acc;
+}
+
+// y = A x one column at a time, only where that is exact (float)
+template <typename T>
+bool _nd_gemv_cols(T *, const T *, ptrdiff_t, const T *, ptrdiff_t, size_t,
+                   size_t, bool) {
+  return false;
+}
+
+#if defined(_ND_LANES)
+template <> struct _nd_gemm_tile<float> {
+  static constexpr size_t mr = 4, nr = 2 * _ND_LANES;
+};
+
+inline void _nd_gemm_kernel(size_t kc, const float *const *a, ptrdiff_t sa,
+                            const float *b, float *t) {
+  const size_t nr = 2 * _ND_LANES;
+  _ND_VF c00 = _ND_VSET1(0), c01 = c00, c10 = c00, c11 = c00, c20 = c00,
+         c21 = c00, c30 = c00, c31 = c00;
+  const float *a0 = a[0], *a1 = a[1], *a2 = a[2], *a3 = a[3];
+  for (size_t k = 0; k < kc; k++, b += nr) {
+    const _ND_VF b0 = _ND_VLOAD(b), b1 = _ND_VLOAD(b + _ND_LANES);
+    const ptrdiff_t o = (ptrdiff_t)k * sa;
+    _ND_VF ar = _ND_VSET1(a0[o]);
+    c00 = _ND_VFMA(ar, b0, c00);
+    c01 = _ND_VFMA(ar, b1, c01);
+    ar = _ND_VSET1(a1[o]);
+    c10 = _ND_VFMA(ar, b0, c10);
+    c11 = _ND_VFMA(ar, b1, c11);
+    ar = _ND_VSET1(a2[o]);
+    c20 = _ND_VFMA(ar, b0, c20);
+    c21 = _ND_VFMA(ar, b1, c21);
+    ar = _ND_VSET1(a3[o]);
+    c30 = _ND_VFMA(ar, b0, c30);
+    c31 = _ND_VFMA(ar, b1, c31);
+  }
+  _ND_VSTORE(t, c00);
+  _ND_VSTORE(t + _ND_LANES, c01);
+  _ND_VSTORE(t + nr, c10);
+  _ND_VSTORE(t + nr + _ND_LANES, c11);
+  _ND_VSTORE(t + 2 * nr, c20);
+  _ND_VSTORE(t + 2 * nr + _ND_LANES, c21);
+  _ND_VSTORE(t + 3 * nr, c30);
+  _ND_VSTORE(t + 3 * nr + _ND_LANES, c31);
+}
+
+inline float _nd_dot_row(const float *a, ptrdiff_t sa, const float *b,
+                         ptrdiff_t sb, size_t n) {
+  if (sa != 1 || sb != 1) {
+    float acc = 0;
+    for (size_t i = 0; i < n; i++)
+      acc += a[(ptrdiff_t)i * sa] * b[(ptrdiff_t)i * sb];
+    return acc;
+  }
+  _ND_VF acc0 = _ND_VSET1(0), acc1 = acc0;
+  size_t i = 0;
+  for (; i + 2 * _ND_LANES <= n; i += 2 * _ND_LANES) {
+    acc0 = _ND_VFMA(_ND_VLOAD(a + i), _ND_VLOAD(b + i), acc0);
+    acc1 = _ND_VFMA(_ND_VLOAD(a + i + _ND_LANES),
+                    _ND_VLOAD(b + i + _ND_LANES), acc1);
+  }
+  float lanes[_ND_LANES];
+  _ND_VSTORE(lanes, _ND_VADD(acc0, acc1));
+  float acc = 0;
+  for (size_t l = 0; l < _ND_LANES; l++)
+    acc += lanes[l];
+  for (; i < n; i++)
+    acc += a[i] * b[i];
+  return acc;
+}
+
+inline bool _nd_gemv_cols(float *y, const float *a, ptrdiff_t sa,
+                          const float *x, ptrdiff_t sx, size_t m, size_t n,
+                          bool accumulate) {
+  if (!accumulate)
+    for (size_t i = 0; i < m; i++)
+      y[i] = 0;
+  for (size_t k = 0; k < n; k++) {
+    const float *col = a + (ptrdiff_t)k * sa, xk = x[(ptrdiff_t)k * sx];
+    const _ND_VF vx = _ND_VSET1(xk);
+    size_t i = 0;
+    for (; i + _ND_LANES <= m; i += _ND_LANES)
+      _ND_VSTORE(y + i, _ND_VFMA(_ND_VLOAD(col + i), vx, _ND_VLOAD(y + i)));
+    for (; i < m; i++)
+      y[i] += col[i] * xk;
+  }
+  return true;
+}
+#endif // _ND_LANES
+
+// C (m x n) = A (m x k) B (k x n), added to C if accumulate
+template <typename T>
+void _nd_gemm(T *c, ptrdiff_t sc0, ptrdiff_t sc1, const T *a, ptrdiff_t sa0,
+              ptrdiff_t sa1, const T *b, ptrdiff_t sb0, ptrdiff_t sb1,
+              size_t m, size_t n, size_t k, bool accumulate) {
+  typedef _nd_dot_acc<T> Acc;
+  const size_t mr = _nd_gemm_tile<T>::mr, nr = _nd_gemm_tile<T>::nr;
+  const size_t kc = NDARRAY_GEMM_KC, nc = NDARRAY_GEMM_NC / nr * nr;
+  static_assert(NDARRAY_GEMM_KC > 0 && NDARRAY_GEMM_NC >= nr,
+                "NDARRAY_GEMM_KC and NDARRAY_GEMM_NC are too small");
+  if (k == 0) {
+    for (size_t i = 0; !accumulate && i < m; i++)
+      for (size_t j = 0; j < n; j++)
+        c[(ptrdiff_t)i * sc0 + (ptrdiff_t)j * sc1] = T(0);
+    return;
+  }
+
+  T packed[NDARRAY_GEMM_KC * (NDARRAY_GEMM_NC / nr * nr)];
+  typename Acc::type t[mr * nr];
+  for (size_t jc = 0; jc < n; jc += nc) {
+    const size_t ncur = n - jc < nc ? n - jc : nc;
+    for (size_t pc = 0; pc < k; pc += kc) {
+      const size_t kcur = k - pc < kc ? k - pc : kc;
+      // Panels of nr columns, k-major, zero padded to nr
+      for (size_t jp = 0; jp < ncur; jp += nr) {
+        T *panel = packed + jp * kcur;
+        for (size_t p = 0; p < kcur; p++) {
+          const T *row = b + (ptrdiff_t)(pc + p) * sb0;
+          for (size_t j = 0; j < nr; j++)
+            panel[p * nr + j] =
+                jp + j < ncur ? row[(ptrdiff_t)(jc + jp + j) * sb1] : T(0);
+        }
+      }
+      const bool add = accumulate || pc > 0;
+      for (size_t i = 0; i < m; i += mr) {
+        // Rows past m repeat the last one, their results are dropped
+        const T *rows[mr];
+        for (size_t r = 0; r < mr; r++)
+          rows[r] = a + (ptrdiff_t)(i + r < m ? i + r : m - 1) * sa0 +
+                    (ptrdiff_t)pc * sa1;
+        const size_t mcur = m - i < mr ? m - i : mr;
+        for (size_t jp = 0; jp < ncur; jp += nr) {
+          _nd_gemm_kernel(kcur, rows, sa1, packed + jp * kcur, t);
+          const size_t ntile = ncur - jp < nr ? ncur - jp : nr;
+          for (size_t r = 0; r < mcur; r++) {
+            T *o = c + (ptrdiff_t)(i + r) * sc0 + (ptrdiff_t)(jc + jp) * sc1;
+            for (size_t j = 0; j < ntile; j++) {
+              T &out = o[(ptrdiff_t)j * sc1];
+              const T dot = Acc::out(t[r * nr + j]);
+              out = add ? out + dot : dot;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Program
+template <typename T>
+bool ndarray_gemm(const ndarray_view<T, 2> &c,
+                  const ndarray_view<const typename _nd_id<T>::type, 2> &a,
+                  const ndarray_view<const typename _nd_id<T>::type, 2> &b,
+                  bool accumulate = false) {
+  if (a.shape[0] != c.shape[0] || b.shape[1] != c.shape[1] ||
+      a.shape[1] != b.shape[0])
+    return false;
+  _nd_gemm(c.data, c.strides[0], c.strides[1], a.data, a.strides[0],
+           a.strides[1], b.data, b.strides[0], b.strides[1], c.shape[0],
+           c.shape[1], a.shape[1], accumulate);
+  return true;
+}
+
+template <typename T>
+bool ndarray_gemv(const ndarray_view<T, 1> &y,
+                  const ndarray_view<const typename _nd_id<T>::type, 2> &a,
+                  const ndarray_view<const typename _nd_id<T>::type, 1> &x,
+                  bool accumulate = false) {
+  typedef _nd_dot_acc<T> Acc;
+  const size_t m = a.shape[0], n = a.shape[1];
+  if (m != y.shape[0] || n != x.shape[0])
+    return false;
+  if (a.strides[0] == 1 && y.strides[0] == 1 && m > 1 &&
+      _nd_gemv_cols(y.data, a.data, a.strides[1], x.data, x.strides[0], m, n,
+                    accumulate))
+    return true;
+  for (size_t i = 0; i < m; i++) {
+    T &out = y.data[(ptrdiff_t)i * y.strides[0]];
+    const T dot = Acc::out(_nd_dot_row(a.data + (ptrdiff_t)i * a.strides[0],
+                                       a.strides[1], x.data, x.strides[0], n));
+    out = accumulate ? out + dot : dot;
+  }
+  return true;
+}
+
+#endif // NDARRAY_GEMM_H_
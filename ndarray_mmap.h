@@ -0,0 +1,222 @@
+// Memory-mapped Files for Multi-dimensional Array Module
+//
+// ndarray_views over files mapped with mmap, for replaying recorded sensor
+// captures on the host that are larger than the memory: nothing is loaded up
+// front, the kernel pages the data in as the view is read, and the view API
+// (slice, select, transpose, ndarray_ops.h, ndarray_reduce.h, ...) works on it
+// unchanged. Paging hints (madvise) tell the kernel to read ahead on
+// sequential scans, to prefetch a slice about to be used or to drop one that
+// is done.
+//
+// The file is a small header followed by the elements in row-major order:
+//
+//     offset 0: "NDAR"
+//     offset 4: dtype (1 byte, the RFC 8746 tag of ndarray_serial.h)
+//     offset 5: rank R (1 byte)
+//     offset 8: the R dimensions (8 byte little-endian integers)
+//     elements from offset 8 + 8 R rounded up to 64 (cache line aligned)
+//
+// Opening checks the dtype and rank against the template arguments. A const
+// element type maps the file read-only, otherwise writes to the view go to the
+// file.
+//
+// Linux/POSIX hosts only. Depends on ndarray.h and ndarray_serial.h (dtype).
+//
+// Defines the following for the user:
+// - ndarray_mmap<T, R>: Mapping of a file of rank R and element type T.
+//   - m.open(path): Maps an existing file, returns false on failure (missing
+//     file, wrong dtype or rank, truncated, a shape too large to address).
+//   - m.create(path, shape): Creates (or truncates) the file for the shape
+//     (size_t[R]) and maps it, the elements are zero (T must not be const).
+//     Returns false on failure.
+//   - m.view: The ndarray_view<T, R> of the elements (empty when not mapped).
+//   - m.sequential(): Hints a sequential scan of the whole file.
+//   - m.prefetch(v), m.release(v): Hints that the elements of the sub-view v
+//     (any rank) will be needed soon, or no more.
+//   - m.sync(): Writes the changes back to the file.
+//   - m.close(): Unmaps the file (also done by the destructor).
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+// #include "ndarray_mmap.h"
+// #include "ndarray_reduce.h"
+//
+// int main() {
+//   ndarray_mmap<const float, 2> capture; // samples x channels
+//   if (!capture.open("capture.nd"))
+//     return 1;
+//   capture.sequential();
+//   float total = ndarray_sum(ndarray_select(capture.view, 1, 0));
+//   // Only the last day (at 100 Hz)
+//   const size_t n = capture.view.shape[0];
+//   ndarray_view<const float, 2> day =
+//       ndarray_slice(capture.view, 0, n - 8640000, n);
+//   capture.prefetch(day);
+//   float peak = ndarray_max(day);
+// }
+// ```
+
+#ifndef NDARRAY_MMAP_H_
+#define NDARRAY_MMAP_H_
+
+#include "ndarray.h"
+#include "ndarray_serial.h"
+#include <stdint.h>
+#include <string.h>
+
+// Dependecies
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#error "ndarray_mmap.h needs a POSIX host (mmap)"
+#endif // POSIX
+
+// Helpers
+template <typename T> struct _nd_writable {
+  static constexpr bool value = true;
+};
+template <typename T> struct _nd_writable<const T> {
+  static constexpr bool value = false;
+};
+
+// Bytes of the header of a file of rank R, a multiple of the cache line
+constexpr size_t _nd_mmap_header(size_t rank) {
+  return (8 + 8 * rank + 63) / 64 * 64;
+}
+
+// Program
+template <typename T, size_t R> struct ndarray_mmap {
+  ndarray_view<T, R> view;
+  void *_base;
+  size_t _length;
+
+  ndarray_mmap() : view(), _base(NULL), _length(0) {}
+  ~ndarray_mmap() { close(); }
+  ndarray_mmap(const ndarray_mmap &) = delete;
+  ndarray_mmap &operator=(const ndarray_mmap &) = delete;
+
+  bool open(const char *path) {
+    close();
+    const bool writable = _nd_writable<T>::value;
+    const int fd = ::open(path, writable ? O_RDWR : O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < _nd_mmap_header(R)) {
+      ::close(fd);
+      return false;
+    }
+    // The mapping outlives the descriptor
+    if (!_map(fd, (size_t)st.st_size, writable))
+      return false;
+
+    const uint8_t *h = (const uint8_t *)_base;
+    size_t shape[R], size = 1;
+    bool overflow = false; // a corrupt shape must not wrap size around
+    for (size_t axis = 0; axis < R; axis++) {
+      uint64_t d = 0;
+      for (size_t i = 0; i < 8; i++)
+        d |= (uint64_t)h[8 + 8 * axis + i] << (8 * i);
+      shape[axis] = (size_t)d;
+      if (d > SIZE_MAX || (shape[axis] != 0 && size > SIZE_MAX / shape[axis]))
+        overflow = true;
+      size *= shape[axis];
+    }
+    if (memcmp(h, "NDAR", 4) != 0 || h[4] != _nd_dtype<T>::tag ||
+        h[5] != R || overflow ||
+        (_length - _nd_mmap_header(R)) / sizeof(T) < size) {
+      close();
+      return false;
+    }
+    view = ndarray_view<T, R>((T *)(h + _nd_mmap_header(R)), shape);
+    return true;
+  }
+
+  bool create(const char *path, const size_t (&shape)[R]) {
+    static_assert(_nd_writable<T>::value,
+                  "ndarray_mmap::create needs a non-const element type");
+    close();
+    size_t size = 1;
+    for (size_t axis = 0; axis < R; axis++) {
+      if (shape[axis] != 0 && size > SIZE_MAX / shape[axis])
+        return false;
+      size *= shape[axis];
+    }
+    if (size > (SIZE_MAX - _nd_mmap_header(R)) / sizeof(T))
+      return false;
+    const size_t length = _nd_mmap_header(R) + size * sizeof(T);
+    const int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return false;
+    if (ftruncate(fd, (off_t)length) != 0) {
+      ::close(fd);
+      return false;
+    }
+    if (!_map(fd, length, true))
+      return false;
+
+    uint8_t *h = (uint8_t *)_base;
+    memcpy(h, "NDAR", 4);
+    h[4] = _nd_dtype<T>::tag;
+    h[5] = (uint8_t)R;
+    for (size_t axis = 0; axis < R; axis++)
+      for (size_t i = 0; i < 8; i++)
+        h[8 + 8 * axis + i] = (uint8_t)((uint64_t)shape[axis] >> (8 * i));
+    view = ndarray_view<T, R>((T *)(h + _nd_mmap_header(R)), shape);
+    return true;
+  }
+
+  void close() {
+    if (_base != NULL)
+      munmap(_base, _length);
+    _base = NULL;
+    _length = 0;
+    view = ndarray_view<T, R>();
+  }
+
+  bool sync() { return _base == NULL || msync(_base, _length, MS_SYNC) == 0; }
+
+  void sequential() {
+    if (_base != NULL)
+      madvise(_base, _length, MADV_SEQUENTIAL);
+  }
+  template <size_t S> void prefetch(const ndarray_view<T, S> &v) {
+    _advise(v, MADV_WILLNEED);
+  }
+  template <size_t S> void release(const ndarray_view<T, S> &v) {
+    _advise(v, MADV_DONTNEED);
+  }
+
+  // Maps fd (and closes it)
+  bool _map(int fd, size_t length, bool writable) {
+    void *base = mmap(NULL, length, PROT_READ | (writable ? PROT_WRITE : 0),
+                      MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+      return false;
+    _base = base;
+    _length = length;
+    return true;
+  }
+
+  // madvise over the pages spanned by the elements of v
+  template <size_t S> void _advise(const ndarray_view<T, S> &v, int advice) {
+    if (_base == NULL || v.size() == 0)
+      return;
+    const char *lo = (const char *)v.data, *hi = lo + sizeof(T);
+    for (size_t axis = 0; axis < S; axis++) {
+      const ptrdiff_t span = (ptrdiff_t)(v.shape[axis] - 1) *
+                             v.strides[axis] * (ptrdiff_t)sizeof(T);
+      (span < 0 ? lo : hi) += span;
+    }
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t start = (uintptr_t)lo / page * page;
+    madvise((void *)start, (size_t)((uintptr_t)hi - start), advice);
+  }
+};
+
+#endif // NDARRAY_MMAP_H_
@@ -0,0 +1,388 @@
+// Elementwise Operations for Multi-dimensional Array Module
+//
+// Vectorized elementwise kernels over ndarray_views (see ndarray.h). Each
+// operation walks the output in memory order (like ndarray_copy) one row of the
+// innermost axis at a time; rows where every operand is contiguous go through
+// the SIMD kernels, the other rows fall back to plain strided loops. Fully
+// contiguous views are handled as a single row.
+//
+// The SIMD kernels are picked from the compiler flags: AVX (+FMA) or SSE2 on
+// x86 hosts and NEON on ARM. Any other target (AVR, ESP8266, ESP32) uses the
+// scalar loops which the compiler is still free to vectorize.
+//
+// Define macroes below before importing the header to configure:
+// ```c
+// #define NDARRAY_SIMD 0    // optional, 0 forces the scalar loops (default 1)
+// #define NDARRAY_ESP_DSP 1 // optional, routes float add/mul/scale through
+//                           // esp-dsp (uses the PIE/SIMD instructions on
+//                           // ESP32-S3 and the optimized assembly on ESP32)
+//                           // (default 0)
+// ```
+//
+// Depends on ndarray.h. The operands of an operation must have the same shape
+// as the output (out may be one of the operands).
+//
+// Defines the following for the user:
+// - ndarray_add(out, a, b): out = a + b
+// - ndarray_mul(out, a, b): out = a * b
+// - ndarray_fma(out, a, b, c): out = a * b + c
+// - ndarray_scale(out, a, k): out = a * k (k is a scalar)
+// - ndarray_clamp(out, a, lo, hi): out = min(max(a, lo), hi)
+// - ndarray_convert(out, a): out = (U)a where U is the element type of out
+//   (a C cast, except that float -> int16_t saturates to [-32768, 32767]
+//   and turns NaN into 0; SIMD for int16_t <-> float).
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+// #include "ndarray_ops.h"
+//
+// NDARRAY_INIT(int16_t, raw, 3, 128);  // ADC samples of 3 axis
+// NDARRAY_INIT(float, scaled, 3, 128); // calibrated samples
+//
+// void loop() {
+//   // ... fill raw
+//   ndarray_convert(scaled.view(), raw.view());
+//   ndarray_scale(scaled.view(), scaled.view(), 3.3f / 4096);
+//   ndarray_clamp(scaled.view(), scaled.view(), 0.0f, 3.0f);
+// }
+// ```
+
+#ifndef NDARRAY_OPS_H_
+#define NDARRAY_OPS_H_
+
+#include "ndarray.h"
+#include <stdint.h>
+
+// Defaults
+#ifndef NDARRAY_SIMD
+#define NDARRAY_SIMD 1
+#endif // NDARRAY_SIMD
+
+#ifndef NDARRAY_ESP_DSP
+#define NDARRAY_ESP_DSP 0
+#endif // NDARRAY_ESP_DSP
+
+// Dependecies
+#if NDARRAY_SIMD == 1 && defined(__AVX__)
+#include <immintrin.h>
+#define _ND_AVX 1
+#elif NDARRAY_SIMD == 1 && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define _ND_SSE 1
+#elif NDARRAY_SIMD == 1 && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define _ND_NEON 1
+#endif // NDARRAY_SIMD
+
+#if NDARRAY_ESP_DSP == 1
+#include "dsps_add.h"
+#include "dsps_mul.h"
+#include "dsps_mulc.h"
+#endif // NDARRAY_ESP_DSP
+
+// Helpers
+// Float vector of the widest enabled instruction set
+#if defined(_ND_AVX)
+#define _ND_LANES 8
+#define _ND_VF __m256
+#define _ND_VLOAD(p) _mm256_loadu_ps(p)
+#define _ND_VSTORE(p, v) _mm256_storeu_ps(p, v)
+#define _ND_VSET1(x) _mm256_set1_ps(x)
+#define _ND_VADD(a, b) _mm256_add_ps(a, b)
+#define _ND_VMUL(a, b) _mm256_mul_ps(a, b)
+#define _ND_VMIN(a, b) _mm256_min_ps(a, b)
+#define _ND_VMAX(a, b) _mm256_max_ps(a, b)
+#if defined(__FMA__)
+#define _ND_VFMA(a, b, c) _mm256_fmadd_ps(a, b, c)
+#else
+#define _ND_VFMA(a, b, c) _mm256_add_ps(_mm256_mul_ps(a, b), c)
+#endif // __FMA__
+#elif defined(_ND_SSE)
+#define _ND_LANES 4
+#define _ND_VF __m128
+#define _ND_VLOAD(p) _mm_loadu_ps(p)
+#define _ND_VSTORE(p, v) _mm_storeu_ps(p, v)
+#define _ND_VSET1(x) _mm_set1_ps(x)
+#define _ND_VADD(a, b) _mm_add_ps(a, b)
+#define _ND_VMUL(a, b) _mm_mul_ps(a, b)
+#define _ND_VMIN(a, b) _mm_min_ps(a, b)
+#define _ND_VMAX(a, b) _mm_max_ps(a, b)
+#define _ND_VFMA(a, b, c) _mm_add_ps(_mm_mul_ps(a, b), c)
+#elif defined(_ND_NEON)
+#define _ND_LANES 4
+#define _ND_VF float32x4_t
+#define _ND_VLOAD(p) vld1q_f32(p)
+#define _ND_VSTORE(p, v) vst1q_f32(p, v)
+#define _ND_VSET1(x) vdupq_n_f32(x)
+#define _ND_VADD(a, b) vaddq_f32(a, b)
+#define _ND_VMUL(a, b) vmulq_f32(a, b)
+#define _ND_VMIN(a, b) vminq_f32(a, b)
+#define _ND_VMAX(a, b) vmaxq_f32(a, b)
+#if defined(__ARM_FEATURE_FMA)
+#define _ND_VFMA(a, b, c) vfmaq_f32(c, a, b)
+#else
+#define _ND_VFMA(a, b, c) vmlaq_f32(c, a, b)
+#endif // __ARM_FEATURE_FMA
+#endif // SIMD float vector
+
+// Contiguous kernels, the generic ones are scalar and the float overloads are
+// vectorized (with a scalar loop for the tail).
+template <typename T>
+void _nd_add(T *o, const T *a, const T *b, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    o[i] = a[i] + b[i];
+}
+template <typename T>
+void _nd_mul(T *o, const T *a, const T *b, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    o[i] = a[i] * b[i];
+}
+template <typename T>
+void _nd_fma(T *o, const T *a, const T *b, const T *c, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    o[i] = a[i] * b[i] + c[i];
+}
+template <typename T> void _nd_scale(T *o, const T *a, T k, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    o[i] = a[i] * k;
+}
+template <typename T> void _nd_clamp(T *o, const T *a, T lo, T hi, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    o[i] = a[i] < lo ? lo : (hi < a[i] ? hi : a[i]);
+}
+template <typename U, typename T>
+void _nd_convert(U *o, const T *a, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    o[i] = (U)a[i];
+}
+// float -> int16_t saturates and NaN gives 0 (as NEON does) on every path
+inline int16_t _nd_saturate_int16(float x) {
+  if (x != x)
+    return 0;
+  if (x <= -32768.0f)
+    return -32768;
+  if (32767.0f <= x)
+    return 32767;
+  return (int16_t)x;
+}
+
+#if defined(_ND_LANES)
+inline void _nd_add(float *o, const float *a, const float *b, size_t n) {
+  size_t i = 0;
+  for (; i + _ND_LANES <= n; i += _ND_LANES)
+    _ND_VSTORE(o + i, _ND_VADD(_ND_VLOAD(a + i), _ND_VLOAD(b + i)));
+  for (; i < n; i++)
+    o[i] = a[i] + b[i];
+}
+inline void _nd_mul(float *o, const float *a, const float *b, size_t n) {
+  size_t i = 0;
+  for (; i + _ND_LANES <= n; i += _ND_LANES)
+    _ND_VSTORE(o + i, _ND_VMUL(_ND_VLOAD(a + i), _ND_VLOAD(b + i)));
+  for (; i < n; i++)
+    o[i] = a[i] * b[i];
+}
+inline void _nd_fma(float *o, const float *a, const float *b, const float *c,
+                    size_t n) {
+  size_t i = 0;
+  for (; i + _ND_LANES <= n; i += _ND_LANES)
+    _ND_VSTORE(o + i, _ND_VFMA(_ND_VLOAD(a + i), _ND_VLOAD(b + i),
+                               _ND_VLOAD(c + i)));
+  for (; i < n; i++)
+    o[i] = a[i] * b[i] + c[i];
+}
+inline void _nd_scale(float *o, const float *a, float k, size_t n) {
+  const _ND_VF vk = _ND_VSET1(k);
+  size_t i = 0;
+  for (; i + _ND_LANES <= n; i += _ND_LANES)
+    _ND_VSTORE(o + i, _ND_VMUL(_ND_VLOAD(a + i), vk));
+  for (; i < n; i++)
+    o[i] = a[i] * k;
+}
+inline void _nd_clamp(float *o, const float *a, float lo, float hi, size_t n) {
+  const _ND_VF vlo = _ND_VSET1(lo), vhi = _ND_VSET1(hi);
+  size_t i = 0;
+  for (; i + _ND_LANES <= n; i += _ND_LANES)
+    _ND_VSTORE(o + i, _ND_VMIN(_ND_VMAX(_ND_VLOAD(a + i), vlo), vhi));
+  for (; i < n; i++)
+    o[i] = a[i] < lo ? lo : (hi < a[i] ? hi : a[i]);
+}
+#endif // _ND_LANES
+
+#if defined(_ND_AVX) || defined(_ND_SSE)
+inline void _nd_convert(float *o, const int16_t *a, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    // Sign extend by placing each int16 in the high half and shifting back
+    _mm_storeu_ps(o + i, _mm_cvtepi32_ps(
+                             _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16)));
+    _mm_storeu_ps(o + i + 4, _mm_cvtepi32_ps(
+                                 _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16)));
+  }
+  for (; i < n; i++)
+    o[i] = (float)a[i];
+}
+inline void _nd_convert(int16_t *o, const float *a, size_t n) {
+  size_t i = 0;
+  const __m128 vmin = _mm_set1_ps(-32768.0f), vmax = _mm_set1_ps(32767.0f);
+  for (; i + 8 <= n; i += 8) {
+    // Zero NaNs and clamp before converting, out of range int32 would give
+    // INT_MIN
+    __m128 x = _mm_loadu_ps(a + i), y = _mm_loadu_ps(a + i + 4);
+    x = _mm_min_ps(_mm_max_ps(_mm_and_ps(x, _mm_cmpord_ps(x, x)), vmin), vmax);
+    y = _mm_min_ps(_mm_max_ps(_mm_and_ps(y, _mm_cmpord_ps(y, y)), vmin), vmax);
+    _mm_storeu_si128((__m128i *)(o + i),
+                     _mm_packs_epi32(_mm_cvttps_epi32(x), _mm_cvttps_epi32(y)));
+  }
+  for (; i < n; i++)
+    o[i] = _nd_saturate_int16(a[i]);
+}
+#elif defined(_ND_NEON)
+inline void _nd_convert(float *o, const int16_t *a, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const int16x8_t x = vld1q_s16(a + i);
+    vst1q_f32(o + i, vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))));
+    vst1q_f32(o + i + 4, vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))));
+  }
+  for (; i < n; i++)
+    o[i] = (float)a[i];
+}
+inline void _nd_convert(int16_t *o, const float *a, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    vst1q_s16(o + i,
+              vcombine_s16(vqmovn_s32(vcvtq_s32_f32(vld1q_f32(a + i))),
+                           vqmovn_s32(vcvtq_s32_f32(vld1q_f32(a + i + 4)))));
+  for (; i < n; i++)
+    o[i] = _nd_saturate_int16(a[i]);
+}
+#else
+inline void _nd_convert(int16_t *o, const float *a, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    o[i] = _nd_saturate_int16(a[i]);
+}
+#endif // int16_t <-> float
+
+#if NDARRAY_ESP_DSP == 1
+inline void _nd_add(float *o, const float *a, const float *b, size_t n) {
+  dsps_add_f32(a, b, o, (int)n, 1, 1, 1);
+}
+inline void _nd_mul(float *o, const float *a, const float *b, size_t n) {
+  dsps_mul_f32(a, b, o, (int)n, 1, 1, 1);
+}
+inline void _nd_scale(float *o, const float *a, float k, size_t n) {
+  dsps_mulc_f32(a, o, (int)n, k, 1, 1);
+}
+#endif // NDARRAY_ESP_DSP
+
+// Row kernels: n elements of each operand with the given strides. The unused
+// operands of the unary operations are ignored.
+template <typename T> struct _nd_add_row {
+  void operator()(size_t n, T *o, ptrdiff_t so, const T *a, ptrdiff_t sa,
+                  const T *b, ptrdiff_t sb, const T *, ptrdiff_t) const {
+    if (so == 1 && sa == 1 && sb == 1)
+      return _nd_add(o, a, b, n);
+    for (; n > 0; n--, o += so, a += sa, b += sb)
+      *o = *a + *b;
+  }
+};
+template <typename T> struct _nd_mul_row {
+  void operator()(size_t n, T *o, ptrdiff_t so, const T *a, ptrdiff_t sa,
+                  const T *b, ptrdiff_t sb, const T *, ptrdiff_t) const {
+    if (so == 1 && sa == 1 && sb == 1)
+      return _nd_mul(o, a, b, n);
+    for (; n > 0; n--, o += so, a += sa, b += sb)
+      *o = *a * *b;
+  }
+};
+template <typename T> struct _nd_fma_row {
+  void operator()(size_t n, T *o, ptrdiff_t so, const T *a, ptrdiff_t sa,
+                  const T *b, ptrdiff_t sb, const T *c, ptrdiff_t sc) const {
+    if (so == 1 && sa == 1 && sb == 1 && sc == 1)
+      return _nd_fma(o, a, b, c, n);
+    for (; n > 0; n--, o += so, a += sa, b += sb, c += sc)
+      *o = *a * *b + *c;
+  }
+};
+template <typename T> struct _nd_scale_row {
+  T k;
+  void operator()(size_t n, T *o, ptrdiff_t so, const T *a, ptrdiff_t sa,
+                  const T *, ptrdiff_t, const T *, ptrdiff_t) const {
+    if (so == 1 && sa == 1)
+      return _nd_scale(o, a, k, n);
+    for (; n > 0; n--, o += so, a += sa)
+      *o = *a * k;
+  }
+};
+template <typename T> struct _nd_clamp_row {
+  T lo, hi;
+  void operator()(size_t n, T *o, ptrdiff_t so, const T *a, ptrdiff_t sa,
+                  const T *, ptrdiff_t, const T *, ptrdiff_t) const {
+    if (so == 1 && sa == 1)
+      return _nd_clamp(o, a, lo, hi, n);
+    for (; n > 0; n--, o += so, a += sa)
+      *o = *a < lo ? lo : (hi < *a ? hi : *a);
+  }
+};
+template <typename U, typename T> struct _nd_convert_row {
+  void operator()(size_t n, U *o, ptrdiff_t so, const T *a, ptrdiff_t sa,
+                  const T *, ptrdiff_t, const T *, ptrdiff_t) const {
+    if (so == 1 && sa == 1)
+      return _nd_convert(o, a, n);
+    // One element at a time through the overloads, so strided rows convert
+    // (and saturate) the same way as contiguous ones
+    for (; n > 0; n--, o += so, a += sa)
+      _nd_convert(o, a, 1);
+  }
+};
+
+// Program
+template <typename T, size_t R>
+void ndarray_add(const ndarray_view<T, R> &out,
+                 const ndarray_view<const typename _nd_id<T>::type, R> &a,
+                 const ndarray_view<const typename _nd_id<T>::type, R> &b) {
+  _nd_rows(out, a, b, b, _nd_add_row<T>());
+}
+
+template <typename T, size_t R>
+void ndarray_mul(const ndarray_view<T, R> &out,
+                 const ndarray_view<const typename _nd_id<T>::type, R> &a,
+                 const ndarray_view<const typename _nd_id<T>::type, R> &b) {
+  _nd_rows(out, a, b, b, _nd_mul_row<T>());
+}
+
+template <typename T, size_t R>
+void ndarray_fma(const ndarray_view<T, R> &out,
+                 const ndarray_view<const typename _nd_id<T>::type, R> &a,
+                 const ndarray_view<const typename _nd_id<T>::type, R> &b,
+                 const ndarray_view<const typename _nd_id<T>::type, R> &c) {
+  _nd_rows(out, a, b, c, _nd_fma_row<T>());
+}
+
+template <typename T, size_t R>
+void ndarray_scale(const ndarray_view<T, R> &out,
+                   const ndarray_view<const typename _nd_id<T>::type, R> &a,
+                   typename _nd_id<T>::type k) {
+  _nd_scale_row<T> row = {k};
+  _nd_rows(out, a, a, a, row);
+}
+
+template <typename T, size_t R>
+void ndarray_clamp(const ndarray_view<T, R> &out,
+                   const ndarray_view<const typename _nd_id<T>::type, R> &a,
+                   typename _nd_id<T>::type lo,
+                   typename _nd_id<T>::type hi) {
+  _nd_clamp_row<T> row = {lo, hi};
+  _nd_rows(out, a, a, a, row);
+}
+
+template <typename U, typename T, size_t R>
+void ndarray_convert(const ndarray_view<U, R> &out,
+                     const ndarray_view<T, R> &a) {
+  const ndarray_view<const T, R> src = a;
+  _nd_rows(out, src, src, src, _nd_convert_row<U, T>());
+}
+
+#endif // NDARRAY_OPS_H_
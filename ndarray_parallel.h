@@ -0,0 +1,315 @@
+// Parallel Loops for Multi-dimensional Array Module
+//
+// Runs ndarray_for_each style loops on every core: the outermost axis of the
+// view is split into chunks which a pool of NDARRAY_THREADS threads (the
+// calling one included) claims one at a time, so a core that finishes early
+// takes the next chunk instead of idling. The pool is created on the first
+// parallel call and reused, so a call costs a wake-up instead of a thread
+// creation:
+// - Hosts: NDARRAY_THREADS - 1 std::threads.
+// - Dual-core ESP32: One FreeRTOS task pinned to the core the first call is
+//   not running on (the loop task runs on core 1, so core 0 next to WiFi).
+// - Anything else (or NDARRAY_THREADS 1): The calling thread alone.
+//
+// Chunks of the split axis start on a cache line boundary of the written
+// view (the first argument) whenever its stride allows it, so two cores
+// never write to the same line (false sharing). There are about 4 chunks per
+// thread to balance uneven work.
+//
+// A parallel call made from inside a parallel loop (or while another thread
+// is running one) runs on the calling thread alone instead of waiting.
+//
+// Define macroes below before importing the header to configure:
+// ```c
+// #define NDARRAY_THREADS 4 // optional, threads of the pool (default 2 on
+//                           // dual-core ESP32, 1 otherwise, hosts require
+//                           // <thread>)
+// #define NDARRAY_CACHE_LINE 64 // optional, bytes of a cache line (default
+//                               // 32 on ESP32, 64 otherwise)
+// #define NDARRAY_PARALLEL_STACK 4096 // optional, stack of the ESP32 task
+//                                     // (default 4096)
+// ```
+//
+// Depends on ndarray.h. fn is called concurrently from several threads, so it
+// must only write to the element it is given (or synchronize).
+//
+// Defines the following for the user:
+// - ndarray_parallel_for_each(v, fn): Same as ndarray_for_each(v, fn).
+// - ndarray_parallel_for_each(a, b, fn): Same as ndarray_for_each(a, b, fn)
+//   (the chunks are aligned for a).
+// - ndarray_parallel_transform(out, a, fn): out = fn(a) for every element.
+// - ndarray_parallel_for(n, fn): Calls fn(i) for every i < n, e.g. one call
+//   per window of a batch.
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+// #include "ndarray_parallel.h"
+// #include "ndarray_fft.h"
+//
+// NDARRAY_INIT(float, spectra, 32, 256, 2); // 32 windows of 256 points
+//
+// void loop() {
+//   // ... fill spectra
+//   ndarray_parallel_for(32, [](size_t w) {
+//     ndarray_fft<256>(ndarray_select(spectra.view(), 0, w));
+//   });
+//   ndarray_parallel_transform(spectra.view(), spectra.view(),
+//                              [](float x) { return x * x; });
+// }
+// ```
+
+#ifndef NDARRAY_PARALLEL_H_
+#define NDARRAY_PARALLEL_H_
+
+#include "ndarray.h"
+
+// Defaults
+#ifndef NDARRAY_THREADS
+#if defined(ESP32) && !defined(CONFIG_FREERTOS_UNICORE)
+#define NDARRAY_THREADS 2
+#else
+#define NDARRAY_THREADS 1
+#endif // ESP32
+#endif // NDARRAY_THREADS
+
+#ifndef NDARRAY_CACHE_LINE
+#if defined(ESP32)
+#define NDARRAY_CACHE_LINE 32
+#else
+#define NDARRAY_CACHE_LINE 64
+#endif // ESP32
+#endif // NDARRAY_CACHE_LINE
+
+#ifndef NDARRAY_PARALLEL_STACK
+#define NDARRAY_PARALLEL_STACK 4096
+#endif // NDARRAY_PARALLEL_STACK
+
+// Dependecies
+#if NDARRAY_THREADS > 1 && defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#define _ND_POOL_FREERTOS 1
+#elif NDARRAY_THREADS > 1
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#define _ND_POOL_THREADS 1
+#endif // NDARRAY_THREADS
+
+// Helpers
+// Indices [0, n) in chunks claimed with an atomic add by every thread
+struct _nd_parallel_job {
+  void (*run)(const void *fn, size_t begin, size_t end);
+  const void *fn;
+  size_t n, chunk;
+  size_t next;
+};
+
+inline void _nd_parallel_work(_nd_parallel_job &job) {
+  for (;;) {
+    const size_t begin =
+        __atomic_fetch_add(&job.next, job.chunk, __ATOMIC_RELAXED);
+    if (begin >= job.n)
+      return;
+    job.run(job.fn, begin,
+            job.n - begin < job.chunk ? job.n : begin + job.chunk);
+  }
+}
+
+#if defined(_ND_POOL_THREADS)
+struct _nd_pool {
+  std::thread workers[NDARRAY_THREADS - 1];
+  std::mutex busy;  // held by the thread running a job
+  std::mutex mutex; // guards the fields below
+  std::condition_variable wake, done;
+  _nd_parallel_job *job;
+  unsigned long generation; // bumped for every job
+  size_t running;           // workers still on the job
+  bool stop;
+
+  _nd_pool() : job(NULL), generation(0), running(0), stop(false) {
+    for (size_t t = 0; t < NDARRAY_THREADS - 1; t++)
+      workers[t] = std::thread([this]() { _worker(); });
+  }
+  ~_nd_pool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    wake.notify_all();
+    for (size_t t = 0; t < NDARRAY_THREADS - 1; t++)
+      workers[t].join();
+  }
+
+  // Whether the current thread is inside a job
+  static bool &inside() {
+    static thread_local bool flag = false;
+    return flag;
+  }
+
+  void _worker() {
+    inside() = true;
+    unsigned long seen = 0;
+    for (;;) {
+      _nd_parallel_job *j;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&]() { return stop || generation != seen; });
+        if (stop)
+          return;
+        seen = generation;
+        j = job;
+      }
+      _nd_parallel_work(*j);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--running == 0)
+        done.notify_one();
+    }
+  }
+
+  void run(_nd_parallel_job &j) {
+    if (inside() || !busy.try_lock()) {
+      _nd_parallel_work(j);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job = &j;
+      running = NDARRAY_THREADS - 1;
+      generation++;
+    }
+    wake.notify_all();
+    inside() = true;
+    _nd_parallel_work(j);
+    inside() = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      done.wait(lock, [&]() { return running == 0; });
+    }
+    busy.unlock();
+  }
+};
+#elif defined(_ND_POOL_FREERTOS)
+struct _nd_pool {
+  TaskHandle_t worker, owner; // owner: task running a job (or NULL)
+  SemaphoreHandle_t busy, done;
+  _nd_parallel_job *job;
+
+  _nd_pool() : worker(NULL), owner(NULL), job(NULL) {
+    busy = xSemaphoreCreateMutex();
+    done = xSemaphoreCreateBinary();
+    xTaskCreatePinnedToCore(_worker, "ndarray", NDARRAY_PARALLEL_STACK, this,
+                            uxTaskPriorityGet(NULL), &worker,
+                            1 - xPortGetCoreID());
+  }
+
+  static void _worker(void *arg) {
+    _nd_pool &pool = *(_nd_pool *)arg;
+    for (;;) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      _nd_parallel_work(*pool.job);
+      xSemaphoreGive(pool.done);
+    }
+  }
+
+  void run(_nd_parallel_job &j) {
+    const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    if (self == worker || self == owner || worker == NULL ||
+        xSemaphoreTake(busy, 0) != pdTRUE) {
+      _nd_parallel_work(j);
+      return;
+    }
+    owner = self;
+    job = &j;
+    xTaskNotifyGive(worker);
+    _nd_parallel_work(j);
+    xSemaphoreTake(done, portMAX_DELAY);
+    owner = NULL;
+    xSemaphoreGive(busy);
+  }
+};
+#endif // _ND_POOL_THREADS
+
+#if defined(_ND_POOL_THREADS) || defined(_ND_POOL_FREERTOS)
+// The pool shared by every parallel call (created on the first one)
+inline _nd_pool &_nd_parallel_pool() {
+  static _nd_pool pool;
+  return pool;
+}
+#endif // _ND_POOL_THREADS || _ND_POOL_FREERTOS
+
+template <typename F>
+void _nd_parallel_call(const void *fn, size_t begin, size_t end) {
+  (*(const F *)fn)(begin, end);
+}
+
+// Calls fn(begin, end) over [0, n) in chunks of chunk indices
+template <typename F> void _nd_parallel(size_t n, size_t chunk, const F &fn) {
+  _nd_parallel_job job = {_nd_parallel_call<F>, &fn, n, chunk ? chunk : 1, 0};
+#if defined(_ND_POOL_THREADS) || defined(_ND_POOL_FREERTOS)
+  if (n > job.chunk) {
+    _nd_parallel_pool().run(job);
+    return;
+  }
+#endif // _ND_POOL_THREADS || _ND_POOL_FREERTOS
+  _nd_parallel_work(job);
+}
+
+constexpr size_t _nd_gcd(size_t a, size_t b) {
+  return b == 0 ? a : _nd_gcd(b, a % b);
+}
+
+// Indices of axis 0 per chunk: about 4 chunks per thread, rounded up so each
+// chunk spans whole cache lines of v
+template <typename T, size_t R>
+size_t _nd_parallel_chunk(const ndarray_view<T, R> &v) {
+  const size_t n = v.shape[0];
+  size_t chunk = (n + 4 * NDARRAY_THREADS - 1) / (4 * NDARRAY_THREADS);
+  const size_t bytes =
+      (size_t)(v.strides[0] < 0 ? -v.strides[0] : v.strides[0]) * sizeof(T);
+  if (bytes != 0) {
+    const size_t align =
+        NDARRAY_CACHE_LINE / _nd_gcd(bytes, NDARRAY_CACHE_LINE);
+    chunk = (chunk + align - 1) / align * align;
+  }
+  return chunk;
+}
+
+// Program
+template <typename F> void ndarray_parallel_for(size_t n, F fn) {
+  _nd_parallel(n, (n + 4 * NDARRAY_THREADS - 1) / (4 * NDARRAY_THREADS),
+               [&](size_t begin, size_t end) {
+                 for (size_t i = begin; i < end; i++)
+                   fn(i);
+               });
+}
+
+template <typename T, size_t R, typename F>
+void ndarray_parallel_for_each(const ndarray_view<T, R> &v, F fn) {
+  _nd_parallel(v.shape[0], _nd_parallel_chunk(v),
+               [&](size_t begin, size_t end) {
+                 ndarray_for_each(
+                     ndarray_slice(v, 0, (ptrdiff_t)begin, (ptrdiff_t)end), fn);
+               });
+}
+
+template <typename T, typename U, size_t R, typename F>
+void ndarray_parallel_for_each(const ndarray_view<T, R> &a,
+                               const ndarray_view<U, R> &b, F fn) {
+  _nd_parallel(a.shape[0], _nd_parallel_chunk(a),
+               [&](size_t begin, size_t end) {
+                 ndarray_for_each(
+                     ndarray_slice(a, 0, (ptrdiff_t)begin, (ptrdiff_t)end),
+                     ndarray_slice(b, 0, (ptrdiff_t)begin, (ptrdiff_t)end), fn);
+               });
+}
+
+template <typename T, typename U, size_t R, typename F>
+void ndarray_parallel_transform(const ndarray_view<T, R> &out,
+                                const ndarray_view<U, R> &a, F fn) {
+  ndarray_parallel_for_each(out, a, [&](T &o, U &x) { o = fn(x); });
+}
+
+#endif // NDARRAY_PARALLEL_H_
@@ -0,0 +1,335 @@
+// Quantization for Multi-dimensional Array Module
+//
+// Affine quantization of float (or qfixed) ndarray_views to 8 bit integers and
+// back, e.g. to send feature vectors at a quarter of their float size or to
+// feed int8 inference kernels. A value x is stored as
+//
+//     q = clamp(round(x / scale) + zero_point, Q_min, Q_max)
+//
+// and read back as (q - zero_point) * scale. The parameters are either one for
+// the whole array (per-tensor) or one per index of an axis (per-channel, e.g.
+// per sensor axis or per output row of a weight matrix), and can be computed
+// from the range of the data. Rounding is to nearest (ties to even).
+//
+// Contiguous float rows use SSE2 (x86 hosts) or NEON (AArch64), 16 elements at
+// a time; other targets and strides use the scalar loops. Like ndarray_ops.h,
+// the output is walked in memory order one row of the innermost axis at a
+// time.
+//
+// Depends on ndarray.h and ndarray_ops.h. The operands must have the same
+// shape.
+//
+// Defines the following for the user:
+// - ndarray_qparams: {scale, zero_point}.
+// - ndarray_qparams_range<Q>(lo, hi): Parameters for values in [lo, hi] (the
+//   range is extended to include 0, which is then exact) and Q (int8_t or
+//   uint8_t).
+// - ndarray_qparams_symmetric<Q>(absmax): Parameters for [-absmax, absmax]
+//   with zero_point 0 (the usual choice for int8 weights).
+// - ndarray_qparams_of<Q>(v): ndarray_qparams_range of the min/max of v.
+// - ndarray_qparams_of<Q>(params, v, axis): Same per index of the axis into
+//   params (an array of v.shape[axis]).
+// - ndarray_quantize(out, a, p): out = quantized a with the parameters p.
+// - ndarray_quantize(out, a, params, axis): Same with params[i] for index i
+//   of the axis.
+// - ndarray_dequantize(out, a, p), ndarray_dequantize(out, a, params, axis):
+//   The inverse.
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+// #include "ndarray_quant.h"
+// #include "ndarray_serial.h"
+//
+// NDARRAY_INIT(float, features, 4, 64);
+// NDARRAY_INIT(int8_t, packed, 4, 64);
+// ndarray_qparams params[4];
+//
+// void loop() {
+//   // ... fill features
+//   ndarray_qparams_of<int8_t>(params, features.view(), 0);
+//   ndarray_quantize(packed.view(), features.view(), params, 0);
+//   // 256 bytes instead of 1024 (send params too to decode)
+//   REQUEST_SEND_NDARRAY(request, packed.view(), NDARRAY_CBOR);
+// }
+// ```
+
+#ifndef NDARRAY_QUANT_H_
+#define NDARRAY_QUANT_H_
+
+#include "ndarray.h"
+#include "ndarray_ops.h"
+#include <math.h>
+#include <stdint.h>
+
+// Quantization parameters
+struct ndarray_qparams {
+  float scale;
+  int32_t zero_point;
+};
+
+// Helpers
+template <typename Q> struct _nd_qlimits {
+  static_assert(sizeof(Q) <= 2, "ndarray quantization is to 8 or 16 bits");
+  static constexpr bool is_signed = Q(-1) < Q(0);
+  static constexpr int32_t min =
+      is_signed ? -((int32_t)1 << (8 * sizeof(Q) - 1)) : 0;
+  static constexpr int32_t max = is_signed
+                                     ? ((int32_t)1 << (8 * sizeof(Q) - 1)) - 1
+                                     : ((int32_t)1 << (8 * sizeof(Q))) - 1;
+};
+
+// x / scale is computed as x * inv, clamped in float to [lo, hi] (the range of
+// Q minus the zero point) so the conversion cannot overflow
+struct _nd_qrow {
+  float inv, lo, hi;
+  int32_t zp;
+  float scale, bias; // dequantization: q * scale + bias
+};
+template <typename Q> _nd_qrow _nd_qrow_of(const ndarray_qparams &p) {
+  const _nd_qrow r = {1 / p.scale,
+                      (float)(_nd_qlimits<Q>::min - p.zero_point),
+                      (float)(_nd_qlimits<Q>::max - p.zero_point),
+                      p.zero_point,
+                      p.scale,
+                      -p.zero_point * p.scale};
+  return r;
+}
+
+template <typename Q, typename T>
+void _nd_quantize(Q *o, const T *a, const _nd_qrow &p, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    const float x = (float)a[i] * p.inv;
+    o[i] = (Q)(lrintf(x < p.lo ? p.lo : (x > p.hi ? p.hi : x)) + p.zp);
+  }
+}
+template <typename T, typename Q>
+void _nd_dequantize(T *o, const Q *a, const _nd_qrow &p, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    o[i] = T((float)a[i] * p.scale + p.bias);
+}
+
+#if defined(_ND_SSE) || defined(_ND_AVX)
+// 4 floats to int32 with the zero point
+inline __m128i _nd_quant4(const float *a, const _nd_qrow &p) {
+  const __m128 x = _mm_mul_ps(_mm_loadu_ps(a), _mm_set1_ps(p.inv));
+  const __m128 c =
+      _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(p.lo)), _mm_set1_ps(p.hi));
+  return _mm_add_epi32(_mm_cvtps_epi32(c), _mm_set1_epi32(p.zp));
+}
+inline __m128i _nd_qpack(__m128i a, __m128i b, int8_t *) {
+  return _mm_packs_epi16(a, b);
+}
+inline __m128i _nd_qpack(__m128i a, __m128i b, uint8_t *) {
+  return _mm_packus_epi16(a, b);
+}
+// Low/high 8 elements widened to int16
+inline __m128i _nd_qwiden_lo(__m128i q, int8_t *) {
+  return _mm_srai_epi16(_mm_unpacklo_epi8(q, q), 8);
+}
+inline __m128i _nd_qwiden_hi(__m128i q, int8_t *) {
+  return _mm_srai_epi16(_mm_unpackhi_epi8(q, q), 8);
+}
+inline __m128i _nd_qwiden_lo(__m128i q, uint8_t *) {
+  return _mm_unpacklo_epi8(q, _mm_setzero_si128());
+}
+inline __m128i _nd_qwiden_hi(__m128i q, uint8_t *) {
+  return _mm_unpackhi_epi8(q, _mm_setzero_si128());
+}
+// 8 int16 to 8 floats of q * scale + bias
+inline void _nd_dequant8(float *o, __m128i w, const _nd_qrow &p) {
+  const __m128 s = _mm_set1_ps(p.scale), b = _mm_set1_ps(p.bias);
+  const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16);
+  const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(w, w), 16);
+  _mm_storeu_ps(o, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), s), b));
+  _mm_storeu_ps(o + 4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), s), b));
+}
+
+template <typename Q>
+void _nd_quantize_simd(Q *o, const float *a, const _nd_qrow &p, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i w0 = _mm_packs_epi32(_nd_quant4(a + i, p),
+                                       _nd_quant4(a + i + 4, p));
+    const __m128i w1 = _mm_packs_epi32(_nd_quant4(a + i + 8, p),
+                                       _nd_quant4(a + i + 12, p));
+    _mm_storeu_si128((__m128i *)(o + i), _nd_qpack(w0, w1, (Q *)0));
+  }
+  _nd_quantize<Q, float>(o + i, a + i, p, n - i); // scalar tail
+}
+template <typename Q>
+void _nd_dequantize_simd(float *o, const Q *a, const _nd_qrow &p, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i q = _mm_loadu_si128((const __m128i *)(a + i));
+    _nd_dequant8(o + i, _nd_qwiden_lo(q, (Q *)0), p);
+    _nd_dequant8(o + i + 8, _nd_qwiden_hi(q, (Q *)0), p);
+  }
+  _nd_dequantize<float, Q>(o + i, a + i, p, n - i); // scalar tail
+}
+#define _ND_QUANT_SIMD 1
+#elif defined(_ND_NEON) && defined(__aarch64__)
+inline int16x8_t _nd_quant8(const float *a, const _nd_qrow &p) {
+  const float32x4_t inv = vdupq_n_f32(p.inv), lo = vdupq_n_f32(p.lo),
+                    hi = vdupq_n_f32(p.hi);
+  const int32x4_t zp = vdupq_n_s32(p.zp);
+  const float32x4_t x0 = vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(a), inv), lo),
+                                   hi);
+  const float32x4_t x1 =
+      vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(a + 4), inv), lo), hi);
+  return vcombine_s16(vqmovn_s32(vaddq_s32(vcvtnq_s32_f32(x0), zp)),
+                      vqmovn_s32(vaddq_s32(vcvtnq_s32_f32(x1), zp)));
+}
+inline void _nd_qstore(int8_t *o, int16x8_t a, int16x8_t b) {
+  vst1q_s8(o, vcombine_s8(vqmovn_s16(a), vqmovn_s16(b)));
+}
+inline void _nd_qstore(uint8_t *o, int16x8_t a, int16x8_t b) {
+  vst1q_u8(o, vcombine_u8(vqmovun_s16(a), vqmovun_s16(b)));
+}
+inline int16x8_t _nd_qwiden_lo(const int8_t *a) {
+  return vmovl_s8(vld1_s8(a));
+}
+inline int16x8_t _nd_qwiden_lo(const uint8_t *a) {
+  return vreinterpretq_s16_u16(vmovl_u8(vld1_u8(a)));
+}
+inline void _nd_dequant8(float *o, int16x8_t w, const _nd_qrow &p) {
+  const float32x4_t s = vdupq_n_f32(p.scale), b = vdupq_n_f32(p.bias);
+  vst1q_f32(o, vfmaq_f32(b, vcvtq_f32_s32(vmovl_s16(vget_low_s16(w))), s));
+  vst1q_f32(o + 4,
+            vfmaq_f32(b, vcvtq_f32_s32(vmovl_s16(vget_high_s16(w))), s));
+}
+
+template <typename Q>
+void _nd_quantize_simd(Q *o, const float *a, const _nd_qrow &p, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    _nd_qstore(o + i, _nd_quant8(a + i, p), _nd_quant8(a + i + 8, p));
+  _nd_quantize<Q, float>(o + i, a + i, p, n - i); // scalar tail
+}
+template <typename Q>
+void _nd_dequantize_simd(float *o, const Q *a, const _nd_qrow &p, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _nd_dequant8(o + i, _nd_qwiden_lo(a + i), p);
+    _nd_dequant8(o + i + 8, _nd_qwiden_lo(a + i + 8), p);
+  }
+  _nd_dequantize<float, Q>(o + i, a + i, p, n - i); // scalar tail
+}
+#define _ND_QUANT_SIMD 1
+#endif // quantization SIMD
+
+#if defined(_ND_QUANT_SIMD)
+inline void _nd_quantize(int8_t *o, const float *a, const _nd_qrow &p,
+                         size_t n) {
+  _nd_quantize_simd(o, a, p, n);
+}
+inline void _nd_quantize(uint8_t *o, const float *a, const _nd_qrow &p,
+                         size_t n) {
+  _nd_quantize_simd(o, a, p, n);
+}
+inline void _nd_dequantize(float *o, const int8_t *a, const _nd_qrow &p,
+                           size_t n) {
+  _nd_dequantize_simd(o, a, p, n);
+}
+inline void _nd_dequantize(float *o, const uint8_t *a, const _nd_qrow &p,
+                           size_t n) {
+  _nd_dequantize_simd(o, a, p, n);
+}
+#endif // _ND_QUANT_SIMD
+
+template <typename Q, typename T> struct _nd_quantize_row {
+  _nd_qrow p;
+  void operator()(size_t n, Q *o, ptrdiff_t so, const T *a, ptrdiff_t sa,
+                  const T *, ptrdiff_t, const T *, ptrdiff_t) const {
+    if (so == 1 && sa == 1)
+      return _nd_quantize(o, a, p, n);
+    for (; n > 0; n--, o += so, a += sa)
+      _nd_quantize(o, a, p, 1);
+  }
+};
+template <typename T, typename Q> struct _nd_dequantize_row {
+  _nd_qrow p;
+  void operator()(size_t n, T *o, ptrdiff_t so, const Q *a, ptrdiff_t sa,
+                  const Q *, ptrdiff_t, const Q *, ptrdiff_t) const {
+    if (so == 1 && sa == 1)
+      return _nd_dequantize(o, a, p, n);
+    for (; n > 0; n--, o += so, a += sa)
+      _nd_dequantize(o, a, p, 1);
+  }
+};
+
+// Program
+template <typename Q>
+ndarray_qparams ndarray_qparams_range(float lo, float hi) {
+  const int32_t qmin = _nd_qlimits<Q>::min, qmax = _nd_qlimits<Q>::max;
+  lo = lo < 0 ? lo : 0;
+  hi = hi > 0 ? hi : 0;
+  ndarray_qparams p = {(hi - lo) / (qmax - qmin), 0};
+  if (!(p.scale > 0))
+    p.scale = 1;
+  const long zp = qmin - lrintf(lo / p.scale);
+  p.zero_point = (int32_t)(zp < qmin ? qmin : (zp > qmax ? qmax : zp));
+  return p;
+}
+
+template <typename Q> ndarray_qparams ndarray_qparams_symmetric(float absmax) {
+  ndarray_qparams p = {absmax / _nd_qlimits<Q>::max, 0};
+  if (!(p.scale > 0))
+    p.scale = 1;
+  return p;
+}
+
+template <typename Q, typename T, size_t R>
+ndarray_qparams ndarray_qparams_of(const ndarray_view<T, R> &v) {
+  float lo = 0, hi = 0;
+  ndarray_for_each(v, [&](T &x) {
+    const float f = (float)x;
+    lo = f < lo ? f : lo;
+    hi = f > hi ? f : hi;
+  });
+  return ndarray_qparams_range<Q>(lo, hi);
+}
+
+template <typename Q, typename T, size_t R>
+void ndarray_qparams_of(ndarray_qparams *params, const ndarray_view<T, R> &v,
+                        size_t axis) {
+  for (size_t i = 0; i < v.shape[axis]; i++)
+    params[i] = ndarray_qparams_of<Q>(ndarray_select(v, axis, i));
+}
+
+template <typename Q, typename T, size_t R>
+void ndarray_quantize(const ndarray_view<Q, R> &out,
+                      const ndarray_view<T, R> &a, const ndarray_qparams &p) {
+  const ndarray_view<const T, R> src = a;
+  const _nd_quantize_row<Q, const T> row = {_nd_qrow_of<Q>(p)};
+  _nd_rows(out, src, src, src, row);
+}
+
+template <typename Q, typename T, size_t R>
+void ndarray_quantize(const ndarray_view<Q, R> &out,
+                      const ndarray_view<T, R> &a,
+                      const ndarray_qparams *params, size_t axis) {
+  for (size_t i = 0; i < out.shape[axis]; i++)
+    ndarray_quantize(ndarray_select(out, axis, i), ndarray_select(a, axis, i),
+                     params[i]);
+}
+
+template <typename T, typename Q, size_t R>
+void ndarray_dequantize(const ndarray_view<T, R> &out,
+                        const ndarray_view<Q, R> &a, const ndarray_qparams &p) {
+  const ndarray_view<const Q, R> src = a;
+  const _nd_dequantize_row<T, const Q> row = {
+      _nd_qrow_of<typename _nd_unconst<Q>::type>(p)};
+  _nd_rows(out, src, src, src, row);
+}
+
+template <typename T, typename Q, size_t R>
+void ndarray_dequantize(const ndarray_view<T, R> &out,
+                        const ndarray_view<Q, R> &a,
+                        const ndarray_qparams *params, size_t axis) {
+  for (size_t i = 0; i < out.shape[axis]; i++)
+    ndarray_dequantize(ndarray_select(out, axis, i),
+                       ndarray_select(a, axis, i), params[i]);
+}
+
+#endif // NDARRAY_QUANT_H_
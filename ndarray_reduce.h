@@ -0,0 +1,433 @@
+// Reductions for Multi-dimensional Array Module
+//
+// Sum, mean, min, max and argmax of ndarray_views (see ndarray.h), either of
+// the whole view or along one axis. Reducing along an axis writes into an
+// R - 1 dimensional output view (the input shape without that axis), so no
+// memory is allocated.
+//
+// Float sums are accurate: by default each lane is summed pairwise (error
+// grows with log(n) instead of n) over 8 independent accumulators, which also
+// keeps the FPU pipeline (or the vector unit of hosts) busy. Kahan summation
+// is available for when accuracy matters more than speed (it breaks with
+// -ffast-math).
+//
+// Setting NDARRAY_THREADS splits large reductions (of the whole view or along
+// an axis) between the threads of the ndarray_parallel.h pool (std::threads
+// on hosts, both cores of a dual-core ESP32). Other MCU builds stay
+// single-threaded and STL free.
+//
+// Define macroes below before importing the header to configure:
+// ```c
+// #define NDARRAY_SUM_MODE 1       // optional, 0 for naive, 1 for pairwise
+//                                  // and 2 for Kahan summation (default 1)
+// #define NDARRAY_THREADS 4        // optional, threads of the pool
+//                                  // (default 1, see ndarray_parallel.h)
+// #define NDARRAY_PARALLEL_MIN 65536 // optional, element count from which
+//                                    // reductions use NDARRAY_THREADS
+//                                    // (default 65536)
+// ```
+//
+// Depends on ndarray.h (and ndarray_parallel.h with NDARRAY_THREADS).
+//
+// Defines the following for the user:
+// - ndarray_sum(out, v, axis), ndarray_mean(out, v, axis): Sum/mean along the
+//   axis, accumulated in the element type of out.
+// - ndarray_min(out, v, axis), ndarray_max(out, v, axis): Smallest/largest
+//   element along the axis.
+// - ndarray_argmax(out, v, axis): Index (along the axis) of the first largest
+//   element, out must be a view of size_t.
+// - ndarray_sum(v), ndarray_mean(v), ndarray_min(v), ndarray_max(v): Same as
+//   above over the whole view.
+// Reducing an empty view (or along an axis of length 0) gives 0 for sum, min,
+// max and argmax (and 0 / 0 for mean), there is no element to return.
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+// #include "ndarray_reduce.h"
+//
+// NDARRAY_INIT(float, window, 3, 256); // 3 axis, 256 samples
+// NDARRAY_INIT(float, mean, 3);
+// NDARRAY_INIT(float, peak, 3);
+//
+// void loop() {
+//   // ... fill window
+//   ndarray_mean(mean.view(), window.view(), 1);
+//   ndarray_max(peak.view(), window.view(), 1);
+// }
+// ```
+
+#ifndef NDARRAY_REDUCE_H_
+#define NDARRAY_REDUCE_H_
+
+#include "ndarray.h"
+
+// Defaults
+#ifndef NDARRAY_SUM_MODE
+#define NDARRAY_SUM_MODE 1
+#endif // NDARRAY_SUM_MODE
+
+#ifndef NDARRAY_THREADS
+#define NDARRAY_THREADS 1
+#endif // NDARRAY_THREADS
+
+#ifndef NDARRAY_PARALLEL_MIN
+#define NDARRAY_PARALLEL_MIN 65536
+#endif // NDARRAY_PARALLEL_MIN
+
+// Dependecies
+#if NDARRAY_THREADS > 1
+#include "ndarray_parallel.h"
+#endif // NDARRAY_THREADS
+
+// Helpers
+// Lane reductions: n elements starting at p, s elements apart
+#define _ND_PAIRWISE_BLOCK 128
+template <typename U, typename T>
+U _nd_pairwise_sum(const T *p, ptrdiff_t s, size_t n) {
+  if (n < 8) {
+    U sum = 0;
+    for (size_t i = 0; i < n; i++)
+      sum += (U)p[(ptrdiff_t)i * s];
+    return sum;
+  }
+  if (n <= _ND_PAIRWISE_BLOCK) {
+    U acc[8];
+    for (size_t k = 0; k < 8; k++)
+      acc[k] = (U)p[(ptrdiff_t)k * s];
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8)
+      for (size_t k = 0; k < 8; k++)
+        acc[k] += (U)p[(ptrdiff_t)(i + k) * s];
+    U sum = ((acc[0] + acc[1]) + (acc[2] + acc[3])) +
+            ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+    for (; i < n; i++)
+      sum += (U)p[(ptrdiff_t)i * s];
+    return sum;
+  }
+  // Split on a multiple of 8 so the halves keep full blocks
+  const size_t half = n / 2 - (n / 2) % 8;
+  return _nd_pairwise_sum<U>(p, s, half) +
+         _nd_pairwise_sum<U>(p + (ptrdiff_t)half * s, s, n - half);
+}
+
+template <typename U, typename T>
+U _nd_kahan_sum(const T *p, ptrdiff_t s, size_t n) {
+  U sum = 0, c = 0;
+  for (size_t i = 0; i < n; i++) {
+    const U y = (U)p[(ptrdiff_t)i * s] - c;
+    const U t = sum + y;
+    c = (t - sum) - y;
+    sum = t;
+  }
+  return sum;
+}
+
+template <typename U, typename T>
+U _nd_lane_sum(const T *p, ptrdiff_t s, size_t n) {
+#if NDARRAY_SUM_MODE == 2
+  return _nd_kahan_sum<U>(p, s, n);
+#elif NDARRAY_SUM_MODE == 1
+  return _nd_pairwise_sum<U>(p, s, n);
+#else
+  U sum = 0;
+  for (size_t i = 0; i < n; i++)
+    sum += (U)p[(ptrdiff_t)i * s];
+  return sum;
+#endif // NDARRAY_SUM_MODE
+}
+
+// Group reductions: g <= 8 neighbouring lanes (gs elements apart) at once, so
+// reducing along an outer axis reads whole cache lines instead of one element
+// per line. Results go to o, so elements apart.
+#define _ND_GROUP 8
+template <typename U, typename T>
+void _nd_pairwise_group(U *acc, const T *p, ptrdiff_t gs, ptrdiff_t s,
+                        size_t n, size_t g) {
+  if (n <= _ND_PAIRWISE_BLOCK) {
+    for (size_t k = 0; k < g; k++)
+      acc[k] = 0;
+    for (size_t i = 0; i < n; i++, p += s)
+      for (size_t k = 0; k < g; k++)
+        acc[k] += (U)p[(ptrdiff_t)k * gs];
+    return;
+  }
+  const size_t half = n / 2;
+  U other[_ND_GROUP];
+  _nd_pairwise_group(acc, p, gs, s, half, g);
+  _nd_pairwise_group(other, p + (ptrdiff_t)half * s, gs, s, n - half, g);
+  for (size_t k = 0; k < g; k++)
+    acc[k] += other[k];
+}
+
+template <typename U> struct _nd_sum_lane {
+  template <typename T> U operator()(const T *p, ptrdiff_t s, size_t n) const {
+    return _nd_lane_sum<U>(p, s, n);
+  }
+  template <typename T>
+  void group(U *o, ptrdiff_t so, const T *p, ptrdiff_t gs, ptrdiff_t s,
+             size_t n, size_t g) const {
+    U acc[_ND_GROUP];
+#if NDARRAY_SUM_MODE == 2
+    U c[_ND_GROUP];
+    for (size_t k = 0; k < g; k++)
+      acc[k] = c[k] = 0;
+    for (size_t i = 0; i < n; i++, p += s)
+      for (size_t k = 0; k < g; k++) {
+        const U y = (U)p[(ptrdiff_t)k * gs] - c[k];
+        const U t = acc[k] + y;
+        c[k] = (t - acc[k]) - y;
+        acc[k] = t;
+      }
+#elif NDARRAY_SUM_MODE == 1
+    _nd_pairwise_group(acc, p, gs, s, n, g);
+#else
+    for (size_t k = 0; k < g; k++)
+      acc[k] = 0;
+    for (size_t i = 0; i < n; i++, p += s)
+      for (size_t k = 0; k < g; k++)
+        acc[k] += (U)p[(ptrdiff_t)k * gs];
+#endif // NDARRAY_SUM_MODE
+    for (size_t k = 0; k < g; k++)
+      o[(ptrdiff_t)k * so] = acc[k];
+  }
+  U combine(U a, U b) const { return a + b; }
+};
+template <typename U> struct _nd_min_lane {
+  template <typename T> U operator()(const T *p, ptrdiff_t s, size_t n) const {
+    if (n == 0)
+      return U();
+    T best = p[0];
+    for (size_t i = 1; i < n; i++)
+      if (p[(ptrdiff_t)i * s] < best)
+        best = p[(ptrdiff_t)i * s];
+    return (U)best;
+  }
+  template <typename T>
+  void group(U *o, ptrdiff_t so, const T *p, ptrdiff_t gs, ptrdiff_t s,
+             size_t n, size_t g) const {
+    T best[_ND_GROUP];
+    for (size_t k = 0; k < g; k++)
+      best[k] = p[(ptrdiff_t)k * gs];
+    for (size_t i = 1; i < n; i++)
+      for (size_t k = 0; k < g; k++)
+        if (p[(ptrdiff_t)i * s + (ptrdiff_t)k * gs] < best[k])
+          best[k] = p[(ptrdiff_t)i * s + (ptrdiff_t)k * gs];
+    for (size_t k = 0; k < g; k++)
+      o[(ptrdiff_t)k * so] = (U)best[k];
+  }
+  U combine(U a, U b) const { return b < a ? b : a; }
+};
+template <typename U> struct _nd_max_lane {
+  template <typename T> U operator()(const T *p, ptrdiff_t s, size_t n) const {
+    if (n == 0)
+      return U();
+    T best = p[0];
+    for (size_t i = 1; i < n; i++)
+      if (best < p[(ptrdiff_t)i * s])
+        best = p[(ptrdiff_t)i * s];
+    return (U)best;
+  }
+  template <typename T>
+  void group(U *o, ptrdiff_t so, const T *p, ptrdiff_t gs, ptrdiff_t s,
+             size_t n, size_t g) const {
+    T best[_ND_GROUP];
+    for (size_t k = 0; k < g; k++)
+      best[k] = p[(ptrdiff_t)k * gs];
+    for (size_t i = 1; i < n; i++)
+      for (size_t k = 0; k < g; k++)
+        if (best[k] < p[(ptrdiff_t)i * s + (ptrdiff_t)k * gs])
+          best[k] = p[(ptrdiff_t)i * s + (ptrdiff_t)k * gs];
+    for (size_t k = 0; k < g; k++)
+      o[(ptrdiff_t)k * so] = (U)best[k];
+  }
+  U combine(U a, U b) const { return a < b ? b : a; }
+};
+struct _nd_argmax_lane {
+  template <typename T>
+  size_t operator()(const T *p, ptrdiff_t s, size_t n) const {
+    size_t best = 0;
+    for (size_t i = 1; i < n; i++)
+      if (p[(ptrdiff_t)best * s] < p[(ptrdiff_t)i * s])
+        best = i;
+    return best;
+  }
+  template <typename T>
+  void group(size_t *o, ptrdiff_t so, const T *p, ptrdiff_t gs, ptrdiff_t s,
+             size_t n, size_t g) const {
+    size_t best[_ND_GROUP] = {0};
+    for (size_t i = 1; i < n; i++)
+      for (size_t k = 0; k < g; k++)
+        if (p[(ptrdiff_t)best[k] * s + (ptrdiff_t)k * gs] <
+            p[(ptrdiff_t)i * s + (ptrdiff_t)k * gs])
+          best[k] = i;
+    for (size_t k = 0; k < g; k++)
+      o[(ptrdiff_t)k * so] = best[k];
+  }
+};
+
+// Row kernel (see _nd_rows) reducing the lanes starting at a row of firsts.
+// Lanes walking memory closer than their neighbours are reduced one by one,
+// the others in groups.
+template <typename U, typename T, typename Lane> struct _nd_lane_rows {
+  const Lane &lane;
+  ptrdiff_t stride;
+  size_t len;
+  void operator()(size_t n, U *o, ptrdiff_t so, const T *f, ptrdiff_t sf,
+                  const T *, ptrdiff_t, const T *, ptrdiff_t) const {
+    if (len == 0) {
+      for (; n > 0; n--, o += so)
+        *o = U();
+      return;
+    }
+    if ((stride < 0 ? -stride : stride) <= (sf < 0 ? -sf : sf)) {
+      for (; n > 0; n--, o += so, f += sf)
+        *o = lane(f, stride, len);
+      return;
+    }
+    for (; n > 0; n -= n < _ND_GROUP ? n : _ND_GROUP) {
+      const size_t g = n < _ND_GROUP ? n : _ND_GROUP;
+      lane.group(o, so, f, sf, stride, len, g);
+      o += (ptrdiff_t)g * so;
+      f += (ptrdiff_t)g * sf;
+    }
+  }
+};
+
+template <typename U, typename T, size_t R, typename Lane>
+void _nd_reduce_axis(const ndarray_view<U, R - 1> &out,
+                     const ndarray_view<T, R> &v, size_t axis,
+                     const Lane &lane) {
+  const ndarray_view<T, R - 1> firsts = ndarray_select(v, axis, 0);
+  const _nd_lane_rows<U, T, Lane> rows = {lane, v.strides[axis],
+                                          v.shape[axis]};
+#if NDARRAY_THREADS > 1
+  // Every thread takes blocks of rows of out
+  if (v.size() >= NDARRAY_PARALLEL_MIN && out.shape[0] > 1) {
+    _nd_parallel(out.shape[0], _nd_parallel_chunk(out),
+                 [&](size_t begin, size_t end) {
+                   const ndarray_view<T, R - 1> f = ndarray_slice(
+                       firsts, 0, (ptrdiff_t)begin, (ptrdiff_t)end);
+                   _nd_rows(ndarray_slice(out, 0, (ptrdiff_t)begin,
+                                          (ptrdiff_t)end),
+                            f, f, f, rows);
+                 });
+    return;
+  }
+#endif // NDARRAY_THREADS
+  _nd_rows(out, firsts, firsts, firsts, rows);
+}
+
+// Reduces every row of the innermost axis and combines the results
+template <size_t R> struct _nd_reduce_rows {
+  template <typename U, typename T, typename Lane>
+  static U run(const ndarray_view<T, R> &v, const Lane &lane) {
+    const ndarray_view<T, R - 1> firsts = ndarray_select(v, R - 1, 0);
+    const ptrdiff_t stride = v.strides[R - 1];
+    const size_t len = v.shape[R - 1];
+    U result = U();
+    bool first = true;
+    ndarray_for_each(firsts, [&](T &row) {
+      const U r = lane(&row, stride, len);
+      result = first ? r : lane.combine(result, r);
+      first = false;
+    });
+    return result;
+  }
+};
+template <> struct _nd_reduce_rows<1> {
+  template <typename U, typename T, typename Lane>
+  static U run(const ndarray_view<T, 1> &v, const Lane &lane) {
+    return lane(v.data, v.strides[0], v.shape[0]);
+  }
+};
+
+// Reduces the whole view: contiguous views are a single lane (split between
+// the threads if large), the others are reduced row by row
+template <typename U, typename T, size_t R, typename Lane>
+U _nd_reduce_all(const ndarray_view<T, R> &v, const Lane &lane) {
+  const size_t n = v.size();
+  if (n == 0)
+    return U();
+  if (v.contiguous()) {
+#if NDARRAY_THREADS > 1
+    if (n >= NDARRAY_PARALLEL_MIN) {
+      // A partial per chunk, combined in order so results do not depend on
+      // which thread took which chunk
+      const size_t chunks = 4 * NDARRAY_THREADS;
+      const size_t chunk = (n + chunks - 1) / chunks;
+      U partial[chunks];
+      _nd_parallel(n, chunk, [&](size_t begin, size_t end) {
+        partial[begin / chunk] = lane(v.data + begin, 1, end - begin);
+      });
+      U result = partial[0];
+      for (size_t c = 1; c * chunk < n; c++)
+        result = lane.combine(result, partial[c]);
+      return result;
+    }
+#endif // NDARRAY_THREADS
+    return lane(v.data, 1, n);
+  }
+  // Rows in memory order, the innermost one has the smallest stride
+  ndarray_view<T, R> ordered = v, unused = v;
+  _nd_memory_order(ordered, unused);
+  return _nd_reduce_rows<R>::template run<U>(ordered, lane);
+}
+
+// Program
+template <typename U, typename T, size_t R>
+void ndarray_sum(const ndarray_view<U, R - 1> &out,
+                 const ndarray_view<T, R> &v, size_t axis) {
+  _nd_reduce_axis(out, v, axis, _nd_sum_lane<U>());
+}
+
+template <typename U, typename T, size_t R>
+void ndarray_mean(const ndarray_view<U, R - 1> &out,
+                  const ndarray_view<T, R> &v, size_t axis) {
+  ndarray_sum(out, v, axis);
+  const U n = (U)v.shape[axis];
+  ndarray_for_each(out, [n](U &x) { x /= n; });
+}
+
+template <typename U, typename T, size_t R>
+void ndarray_min(const ndarray_view<U, R - 1> &out,
+                 const ndarray_view<T, R> &v, size_t axis) {
+  _nd_reduce_axis(out, v, axis, _nd_min_lane<U>());
+}
+
+template <typename U, typename T, size_t R>
+void ndarray_max(const ndarray_view<U, R - 1> &out,
+                 const ndarray_view<T, R> &v, size_t axis) {
+  _nd_reduce_axis(out, v, axis, _nd_max_lane<U>());
+}
+
+template <typename T, size_t R>
+void ndarray_argmax(const ndarray_view<size_t, R - 1> &out,
+                    const ndarray_view<T, R> &v, size_t axis) {
+  _nd_reduce_axis(out, v, axis, _nd_argmax_lane());
+}
+
+template <typename T, size_t R>
+typename _nd_unconst<T>::type ndarray_sum(const ndarray_view<T, R> &v) {
+  typedef typename _nd_unconst<T>::type U;
+  return _nd_reduce_all<U>(v, _nd_sum_lane<U>());
+}
+
+template <typename T, size_t R>
+typename _nd_unconst<T>::type ndarray_mean(const ndarray_view<T, R> &v) {
+  return ndarray_sum(v) / (typename _nd_unconst<T>::type)v.size();
+}
+
+template <typename T, size_t R>
+typename _nd_unconst<T>::type ndarray_min(const ndarray_view<T, R> &v) {
+  typedef typename _nd_unconst<T>::type U;
+  return _nd_reduce_all<U>(v, _nd_min_lane<U>());
+}
+
+template <typename T, size_t R>
+typename _nd_unconst<T>::type ndarray_max(const ndarray_view<T, R> &v) {
+  typedef typename _nd_unconst<T>::type U;
+  return _nd_reduce_all<U>(v, _nd_max_lane<U>());
+}
+
+#endif // NDARRAY_REDUCE_H_
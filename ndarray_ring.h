@@ -0,0 +1,184 @@
+// Circular Time-series for Multi-dimensional Array Module
+//
+// A ring buffer of N samples of shape C where the leading axis is time, for
+// sliding sensor windows. Pushing a sample is O(1): it overwrites the oldest
+// slot instead of shifting the window (a memmove of the whole window per
+// sample at kHz rates is most of the CPU).
+//
+// The buffer holds the samples in slot order, so the window [t - n, t) is one
+// contiguous block until the ring wraps and two blocks after that. window(n)
+// returns these as two ndarray_views (the second one is empty when the window
+// does not wrap) which ndarray_for_each walks in time order. Code that needs a
+// single contiguous view (e.g. an FFT) can call linearize() which rotates the
+// buffer in place (O(N), no extra memory) so that view() is valid.
+//
+// Depends on ndarray.h. Like ndarray, the ring is a view over a buffer of
+// N * prod(C) elements owned by the user.
+//
+// Defines the following for the user:
+// - ndarray_ring<T, N, C...>: Ring of N samples of shape C (use C = 1 for a
+//   scalar series).
+//   - r.push(): Advances the ring and returns the ndarray<T, C...> of the new
+//     (overwritten) sample to be filled.
+//   - r.push(sample): Same as above, copying the prod(C) elements of sample.
+//   - r.size(), r.full(): Number of samples in the ring, and if it is N.
+//   - r[t]: The ndarray<T, C...> of the t-th sample (0 is the oldest).
+//   - r(t, c...): Reference to element c of the t-th sample.
+//   - r.newest(k): The ndarray<T, C...> of the k-th newest sample (0 is the
+//     last pushed).
+//   - r.window(n): The last n (default all) samples as an ndarray_ring_window.
+//   - r.contiguous(): Whether all samples are in time order in one block.
+//   - r.linearize(): Rotates the buffer so that contiguous() holds.
+//   - r.view(): The samples as an ndarray_view<T, 1 + |C|> (empty if not
+//     contiguous()).
+//   - r.clear(): Empties the ring.
+// - ndarray_ring_window<T, R>: Two ndarray_views, first (older samples) and
+//   second (newer samples, possibly empty).
+//   - w.size(): Number of samples in both.
+//   - w(t, c...): Reference to element c of the t-th sample of the window.
+// - ndarray_for_each(w, fn): Calls fn(element) over the window in time order.
+// - NDARRAY_RING_INIT(type, variable_name, n, ...): Defines the buffer
+//   (variable_name##_buf) and a ring of n samples of the given shape.
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+// #include "ndarray_ring.h"
+//
+// NDARRAY_RING_INIT(float, accel, 256, 3); // last 256 samples of 3 axis
+//
+// void loop() {
+//   ndarray<float, 3> sample = accel.push();
+//   sample(0) = analogRead(A0);
+//   sample(1) = analogRead(A1);
+//   sample(2) = analogRead(A2);
+//
+//   float energy = 0;
+//   ndarray_for_each(accel.window(64), [&](float &x) { energy += x * x; });
+// }
+// ```
+
+#ifndef NDARRAY_RING_H_
+#define NDARRAY_RING_H_
+
+#include "ndarray.h"
+
+// Program
+template <typename T, size_t R> struct ndarray_ring_window {
+  ndarray_view<T, R> first, second;
+
+  size_t size() const { return first.shape[0] + second.shape[0]; }
+
+  template <typename... I> T &operator()(size_t t, I... c) const {
+    return t < first.shape[0] ? first(t, c...)
+                              : second(t - first.shape[0], c...);
+  }
+};
+
+template <typename T, size_t R, typename F>
+void ndarray_for_each(const ndarray_ring_window<T, R> &w, F fn) {
+  ndarray_for_each(w.first, fn);
+  ndarray_for_each(w.second, fn);
+}
+
+template <typename T, size_t N, size_t... C> struct ndarray_ring {
+  static_assert(N > 0 && sizeof...(C) > 0,
+                "ndarray_ring needs a length and a sample shape");
+  typedef ndarray<T, C...> sample_type;
+  typedef ndarray_view<T, 1 + sizeof...(C)> view_type;
+
+  static constexpr size_t length = N;
+  static constexpr size_t sample_size = _nd_prod<C...>::value;
+
+  T *data;
+  size_t head;  // slot of the next push
+  size_t count; // samples in the ring
+
+  explicit ndarray_ring(T *data) : data(data), head(0), count(0) {}
+
+  size_t size() const { return count; }
+  bool full() const { return count == N; }
+  void clear() { head = count = 0; }
+
+  sample_type push() {
+    T *slot = data + head * sample_size;
+    head = head + 1 == N ? 0 : head + 1;
+    if (count < N)
+      count++;
+    return sample_type(slot);
+  }
+  sample_type push(const T *sample) {
+    sample_type slot = push();
+    for (size_t i = 0; i < sample_size; i++)
+      slot[i] = sample[i];
+    return slot;
+  }
+
+  // Slot of the t-th sample, a compare instead of a modulo
+  size_t slot(size_t t) const {
+    const size_t s = head + (N - count) + t;
+    return s >= N ? (s >= 2 * N ? s - 2 * N : s - N) : s;
+  }
+  sample_type operator[](size_t t) const {
+    return sample_type(data + slot(t) * sample_size);
+  }
+  template <typename... I> T &operator()(size_t t, I... c) const {
+    return (*this)[t](c...);
+  }
+  sample_type newest(size_t k = 0) const { return (*this)[count - 1 - k]; }
+
+  ndarray_ring_window<T, 1 + sizeof...(C)> window(size_t n) const {
+    if (n > count)
+      n = count;
+    const size_t start = slot(count - n);
+    const size_t first = N - start < n ? N - start : n;
+    ndarray_ring_window<T, 1 + sizeof...(C)> w = {
+        view_type(data + start * sample_size, first, C...),
+        view_type(data, n - first, C...)};
+    return w;
+  }
+  ndarray_ring_window<T, 1 + sizeof...(C)> window() const {
+    return window(count);
+  }
+
+  bool contiguous() const { return slot(0) + count <= N; }
+
+  // Rotates the slots left by slot(0) with three reversals
+  void linearize() {
+    const size_t shift = slot(0);
+    if (shift == 0)
+      return;
+    _reverse(0, shift);
+    _reverse(shift, N);
+    _reverse(0, N);
+    head = count == N ? 0 : count;
+  }
+
+  view_type view() const {
+    return contiguous() ? view_type(data + slot(0) * sample_size, count, C...)
+                        : view_type();
+  }
+
+  // Reverses the order of the samples in the slots [begin, end)
+  void _reverse(size_t begin, size_t end) {
+    for (; begin + 1 < end; begin++, end--) {
+      T *a = data + begin * sample_size, *b = data + (end - 1) * sample_size;
+      for (size_t i = 0; i < sample_size; i++) {
+        const T tmp = a[i];
+        a[i] = b[i];
+        b[i] = tmp;
+      }
+    }
+  }
+};
+
+template <typename T, size_t N, size_t... C>
+constexpr size_t ndarray_ring<T, N, C...>::length;
+template <typename T, size_t N, size_t... C>
+constexpr size_t ndarray_ring<T, N, C...>::sample_size;
+
+#define NDARRAY_RING_INIT(type, variable_name, n, ...)                         \
+  type variable_name##_buf[(n)*NDARRAY_SIZE(__VA_ARGS__)];                     \
+  ndarray_ring<type, n, __VA_ARGS__> variable_name(variable_name##_buf)
+
+#endif // NDARRAY_RING_H_
@@ -0,0 +1,216 @@
+// Rolling Statistics for Multi-dimensional Array Module
+//
+// Per-channel statistics of a sliding window of samples, updated in O(1) per
+// pushed sample instead of rescanning the window, so the cost per sample does
+// not grow with the window length:
+// - ndarray_rolling: mean and variance of the last N samples, kept in an
+//   ndarray_ring. Welford's update adds the new sample and removes the evicted
+//   one, which is much less prone to cancellation than sum/sum of squares.
+// - ndarray_rolling_extrema: min and max of the last N samples with one
+//   monotonic deque per channel and extremum (amortized O(1), each sample
+//   enters and leaves a deque once). It does not need the window itself.
+// - ndarray_ewma: exponentially weighted moving average, no window at all.
+//
+// The statistics are computed in float (double for double samples) so int
+// and fixed-point samples work too. Their storage is inside the structs and
+// sized at compile-time: ndarray_rolling and ndarray_ewma keep a few floats
+// per channel, ndarray_rolling_extrema 2 * N * (sizeof(T) + 4) bytes per
+// channel.
+//
+// Depends on ndarray.h and ndarray_ring.h.
+//
+// Defines the following for the user:
+// - ndarray_rolling<T, N, C...>: Ring of N samples of shape C (over a user
+//   buffer of N * prod(C) elements) with the mean and variance of each channel.
+//   - r.push(sample): Pushes the prod(C) elements of sample.
+//   - r.ring: The ndarray_ring of the window.
+//   - r.size(): Number of samples in the window.
+//   - r.mean(c...), r.variance(c...): Mean and (population) variance of
+//     channel c over the window.
+// - ndarray_rolling_extrema<T, N, C...>: Min and max of each channel of the
+//   last N samples.
+//   - e.push(sample): Pushes the prod(C) elements of sample.
+//   - e.min(c...), e.max(c...): Min and max of channel c (0 before the first
+//     push).
+// - ndarray_ewma<T, C...>: EWMA of each channel.
+//   - ndarray_ewma(alpha): Weight of the new sample in (0, 1].
+//   - a.push(sample): Pushes the prod(C) elements of sample, the first one
+//     initializes the average.
+//   - a.value(c...): Average of channel c.
+// - NDARRAY_ROLLING_INIT(type, variable_name, n, ...): Defines the buffer
+//   (variable_name##_buf) and an ndarray_rolling of n samples of the given
+//   shape.
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+// #include "ndarray_rolling.h"
+//
+// NDARRAY_ROLLING_INIT(float, accel, 256, 3);
+// ndarray_rolling_extrema<float, 256, 3> accel_range;
+// ndarray_ewma<float, 3> accel_smooth(0.1f);
+//
+// void loop() {
+//   float sample[3] = {analogRead(A0), analogRead(A1), analogRead(A2)};
+//   accel.push(sample);
+//   accel_range.push(sample);
+//   accel_smooth.push(sample);
+//   if (accel.variance(2) > 4 * accel.mean(2))
+//     Serial.println(accel_range.max(2) - accel_range.min(2));
+// }
+// ```
+
+#ifndef NDARRAY_ROLLING_H_
+#define NDARRAY_ROLLING_H_
+
+#include "ndarray.h"
+#include "ndarray_ring.h"
+#include <stdint.h>
+
+// Helpers
+// Type of the statistics of T samples
+template <typename T> struct _nd_rolling_type {
+  typedef float type;
+};
+template <> struct _nd_rolling_type<double> {
+  typedef double type;
+};
+
+// Program
+template <typename T, size_t N, size_t... C> struct ndarray_rolling {
+  typedef typename _nd_rolling_type<T>::type U;
+  static constexpr size_t channels = _nd_prod<C...>::value;
+
+  ndarray_ring<T, N, C...> ring;
+  U _mean[channels];
+  U _m2[channels]; // sum of squared differences from the mean
+
+  explicit ndarray_rolling(T *data) : ring(data), _mean(), _m2() {}
+
+  size_t size() const { return ring.size(); }
+
+  void push(const T *sample) {
+    if (ring.full()) {
+      // Replace y by x: the mean moves by (x - y) / N and
+      // M2 += (x - y) (x - mean' + y - mean)
+      const T *evicted = ring[0].data;
+      for (size_t c = 0; c < channels; c++) {
+        const U x = (U)sample[c], y = (U)evicted[c];
+        const U mean = _mean[c] + (x - y) / (U)N;
+        _m2[c] += (x - y) * (x - mean + y - _mean[c]);
+        _mean[c] = mean;
+      }
+    } else {
+      const U n = (U)(ring.size() + 1);
+      for (size_t c = 0; c < channels; c++) {
+        const U x = (U)sample[c];
+        const U mean = _mean[c] + (x - _mean[c]) / n;
+        _m2[c] += (x - _mean[c]) * (x - mean);
+        _mean[c] = mean;
+      }
+    }
+    ring.push(sample);
+  }
+
+  template <typename... I> U mean(I... c) const {
+    return _mean[_nd_offset<C...>::at(0, c...)];
+  }
+  // Rounding can leave M2 slightly negative for a constant window
+  template <typename... I> U variance(I... c) const {
+    const U m2 = _m2[_nd_offset<C...>::at(0, c...)];
+    return ring.size() == 0 || m2 <= 0 ? 0 : m2 / (U)ring.size();
+  }
+};
+
+template <typename T, size_t N, size_t... C>
+constexpr size_t ndarray_rolling<T, N, C...>::channels;
+
+template <typename T, size_t N, size_t... C> struct ndarray_rolling_extrema {
+  static constexpr size_t channels = _nd_prod<C...>::value;
+
+  // Deque k (0 min, 1 max) of channel c: the samples that can still become
+  // the extremum, in time order with strictly monotonic values, stored
+  // circularly in _value[k][c] and _time[k][c] from _head[k][c]
+  T _value[2][channels][N];
+  uint32_t _time[2][channels][N];
+  size_t _head[2][channels];
+  size_t _count[2][channels];
+  uint32_t t; // samples pushed
+
+  ndarray_rolling_extrema() : _head(), _count(), t(0) {}
+
+  void push(const T *sample) {
+    for (size_t c = 0; c < channels; c++) {
+      _push(0, c, sample[c]);
+      _push(1, c, sample[c]);
+    }
+    t++;
+  }
+
+  template <typename... I> T min(I... c) const {
+    const size_t i = _nd_offset<C...>::at(0, c...);
+    return _count[0][i] > 0 ? _value[0][i][_head[0][i]] : T();
+  }
+  template <typename... I> T max(I... c) const {
+    const size_t i = _nd_offset<C...>::at(0, c...);
+    return _count[1][i] > 0 ? _value[1][i][_head[1][i]] : T();
+  }
+
+  void _push(size_t k, size_t c, const T &x) {
+    T *value = _value[k][c];
+    uint32_t *time = _time[k][c];
+    size_t &head = _head[k][c], &count = _count[k][c];
+    // Expire the front (unsigned difference survives t wrapping)
+    if (count > 0 && t - time[head] >= N) {
+      head = head + 1 == N ? 0 : head + 1;
+      count--;
+    }
+    // Drop the back samples that x dominates
+    while (count > 0) {
+      size_t back = head + count - 1;
+      back = back >= N ? back - N : back;
+      if (k == 0 ? value[back] < x : x < value[back])
+        break;
+      count--;
+    }
+    size_t slot = head + count;
+    slot = slot >= N ? slot - N : slot;
+    value[slot] = x;
+    time[slot] = t;
+    count++;
+  }
+};
+
+template <typename T, size_t N, size_t... C>
+constexpr size_t ndarray_rolling_extrema<T, N, C...>::channels;
+
+template <typename T, size_t... C> struct ndarray_ewma {
+  typedef typename _nd_rolling_type<T>::type U;
+  static constexpr size_t channels = _nd_prod<C...>::value;
+
+  U alpha;
+  U _value[channels];
+  bool _started;
+
+  explicit ndarray_ewma(U alpha) : alpha(alpha), _value(), _started(false) {}
+
+  void push(const T *sample) {
+    for (size_t c = 0; c < channels; c++)
+      _value[c] = _started ? _value[c] + alpha * ((U)sample[c] - _value[c])
+                           : (U)sample[c];
+    _started = true;
+  }
+
+  template <typename... I> U value(I... c) const {
+    return _value[_nd_offset<C...>::at(0, c...)];
+  }
+};
+
+template <typename T, size_t... C>
+constexpr size_t ndarray_ewma<T, C...>::channels;
+
+#define NDARRAY_ROLLING_INIT(type, variable_name, n, ...)                      \
+  type variable_name##_buf[(n)*NDARRAY_SIZE(__VA_ARGS__)];                     \
+  ndarray_rolling<type, n, __VA_ARGS__> variable_name(variable_name##_buf)
+
+#endif // NDARRAY_ROLLING_H_
@@ -0,0 +1,253 @@
+// Serialization for Multi-dimensional Array Module
+//
+// Writes an ndarray view (shape, dtype and elements) straight to a network
+// client (or any Arduino Print, i.e. anything with
+// `size_t write(const uint8_t *, size_t)`) instead of formatting it into a
+// String first, which needs several times the size of the array in heap.
+// Contiguous views are written with a single write from their own memory.
+// Strided views are written row by row: rows of consecutive elements still
+// go straight from the view, other rows are gathered into a small chunk on the
+// stack (NDARRAY_SERIAL_CHUNK bytes) which is written whenever it fills up.
+//
+// Two formats:
+// - NDARRAY_RAW: 1 byte dtype, 1 byte rank, the dimensions as 4 byte
+//   little-endian integers and the elements.
+// - NDARRAY_CBOR: An RFC 8746 multi-dimensional array, i.e.
+//   40([[dimensions], typed array]) (tag 40 is row-major), readable by any
+//   CBOR decoder (e.g. cbor2 in Python).
+// The dtype of both is the tag of the RFC 8746 typed array of the element
+// type, e.g. 85 for little-endian float32. The elements are sent in the byte
+// order of the target (little-endian on all the supported boards), which the
+// tag records. qfixed elements of ndarray_fixed.h are sent as their raw
+// integers.
+//
+// Define macroes below before importing the header to configure:
+// ```c
+// #define NDARRAY_SERIAL_CHUNK 64 // optional, bytes of the stack buffer used
+//                                 // for strided views (default 64)
+// ```
+//
+// Depends on ndarray.h. When imported after "Dynamic Request Module"
+// (request.h), it also defines REQUEST_SEND_NDARRAY.
+//
+// Defines the following for the user:
+// - NDARRAY_RAW, NDARRAY_CBOR: The formats (ndarray_format).
+// - ndarray_encoded_size(v, format): Bytes written for the view v.
+// - ndarray_write(out, v, format): Writes v to out, returns whether all of it
+//   was accepted.
+// - REQUEST_SEND_NDARRAY(client, v, format): Same as REQUEST_SEND with the
+//   encoded v as data. HTTP sends it as the body (with Content-Length and a
+//   Content-Type of application/cbor or application/octet-stream, so
+//   REQUEST_METHOD should be "POST" or "PUT"), MQTT streams it with
+//   beginPublish/endPublish. v can be anything with an ndarray_write overload
+//   (e.g. the sparse matrices of ndarray_sparse.h).
+//
+// Example:
+// ```c
+// #include "network.h"
+// #include "request.h"
+// #include "ndarray.h"
+// #include "ndarray_serial.h"
+//
+// NETWORK_INIT(network);
+// REQUEST_INIT(network, request);
+// NDARRAY_INIT(int16_t, samples, 3, 128);
+//
+// void loop() {
+//   NETWORK_LOOP();
+//   REQUEST_LOOP(request);
+//   // ... fill samples
+//   REQUEST_SEND_NDARRAY(request, samples.view(), NDARRAY_CBOR);
+//   // Every other sample of the first channel: written in chunks
+//   ndarray_view<int16_t, 1> first = ndarray_select(samples.view(), 0, 0);
+//   REQUEST_SEND_NDARRAY(request, ndarray_slice(first, 0, 0, 128, 2),
+//                        NDARRAY_RAW);
+// }
+// ```
+
+#ifndef NDARRAY_SERIAL_H_
+#define NDARRAY_SERIAL_H_
+
+#include "ndarray.h"
+#include <stdint.h>
+#include <string.h>
+
+// Defaults
+#ifndef NDARRAY_SERIAL_CHUNK
+#define NDARRAY_SERIAL_CHUNK 64
+#endif // NDARRAY_SERIAL_CHUNK
+
+// Helpers
+template <typename S, int F> struct qfixed; // ndarray_fixed.h
+
+// Little-endian flag of the RFC 8746 tags
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define _ND_TAG_LE 0
+#else
+#define _ND_TAG_LE 4
+#endif // __BYTE_ORDER__
+
+// RFC 8746 typed array tag: 0b010fsell (float, signed, little-endian, log2 of
+// the size in bytes, minus 1 for floats)
+template <typename T> struct _nd_dtype {
+  static constexpr bool is_float = T(1) / T(2) != T(0);
+  static constexpr uint8_t tag =
+      64 | (is_float ? 16 : (T(-1) < T(0) ? 8 : 0)) |
+      (sizeof(T) > 1 ? _ND_TAG_LE : 0) |
+      (_nd_log2_ceil(sizeof(T)) - (is_float ? 1 : 0));
+};
+template <typename T> struct _nd_dtype<const T> : _nd_dtype<T> {};
+template <typename S, int F> struct _nd_dtype<qfixed<S, F> > : _nd_dtype<S> {};
+
+// Appends the CBOR head of major type m and argument x, returns its length
+inline size_t _nd_cbor_head(uint8_t *p, uint8_t m, uint64_t x) {
+  if (x < 24) {
+    p[0] = (uint8_t)(m << 5 | x);
+    return 1;
+  }
+  const size_t bytes =
+      x <= 0xff ? 1 : (x <= 0xffff ? 2 : (x <= 0xffffffff ? 4 : 8));
+  p[0] = (uint8_t)(m << 5 | (24 + _nd_log2_ceil(bytes)));
+  for (size_t i = 0; i < bytes; i++)
+    p[1 + i] = (uint8_t)(x >> (8 * (bytes - 1 - i)));
+  return 1 + bytes;
+}
+
+// Program
+enum ndarray_format { NDARRAY_RAW, NDARRAY_CBOR };
+
+// Writes the header of v into h (at most 15 + 9 R bytes), returns its length
+template <typename T, size_t R>
+size_t _nd_serial_header(uint8_t *h, const ndarray_view<T, R> &v,
+                         ndarray_format format) {
+  static_assert(R < 24, "ndarray serialization supports ranks below 24");
+  size_t n = 0;
+  if (format == NDARRAY_RAW) {
+    h[n++] = _nd_dtype<T>::tag;
+    h[n++] = (uint8_t)R;
+    for (size_t axis = 0; axis < R; axis++)
+      for (size_t i = 0; i < 4; i++)
+        h[n++] = (uint8_t)(v.shape[axis] >> (8 * i));
+    return n;
+  }
+  n += _nd_cbor_head(h + n, 6, 40); // row-major multi-dimensional array
+  n += _nd_cbor_head(h + n, 4, 2);
+  n += _nd_cbor_head(h + n, 4, R);
+  for (size_t axis = 0; axis < R; axis++)
+    n += _nd_cbor_head(h + n, 0, v.shape[axis]);
+  n += _nd_cbor_head(h + n, 6, _nd_dtype<T>::tag);
+  n += _nd_cbor_head(h + n, 2, (uint64_t)v.size() * sizeof(T));
+  return n;
+}
+
+template <typename T, size_t R>
+size_t ndarray_encoded_size(const ndarray_view<T, R> &v,
+                            ndarray_format format) {
+  uint8_t h[15 + 9 * R];
+  return _nd_serial_header(h, v, format) + v.size() * sizeof(T);
+}
+
+template <typename Out, typename T, size_t R>
+bool ndarray_write(Out &out, const ndarray_view<T, R> &v,
+                   ndarray_format format) {
+  uint8_t h[15 + 9 * R];
+  const size_t n = _nd_serial_header(h, v, format);
+  if (out.write(h, n) != n)
+    return false;
+  const size_t size = v.size();
+  if (size == 0)
+    return true;
+  if (v.contiguous())
+    return out.write((const uint8_t *)v.data, size * sizeof(T)) ==
+           size * sizeof(T);
+
+  // Rows of the last axis in logical order
+  const size_t row = v.shape[R - 1], row_bytes = row * sizeof(T);
+  const ptrdiff_t s = v.strides[R - 1];
+  uint8_t chunk[NDARRAY_SERIAL_CHUNK < sizeof(T) ? sizeof(T)
+                                                 : NDARRAY_SERIAL_CHUNK];
+  size_t used = 0;
+  size_t idx[R] = {0};
+  const T *p = v.data;
+  for (size_t rows = size / row; rows-- > 0;) {
+    if (s == 1 && row_bytes >= sizeof(chunk)) {
+      if ((used && out.write(chunk, used) != used) ||
+          out.write((const uint8_t *)p, row_bytes) != row_bytes)
+        return false;
+      used = 0;
+    } else
+      for (size_t i = 0; i < row; i++) {
+        if (used + sizeof(T) > sizeof(chunk)) {
+          if (out.write(chunk, used) != used)
+            return false;
+          used = 0;
+        }
+        memcpy(chunk + used, p + (ptrdiff_t)i * s, sizeof(T));
+        used += sizeof(T);
+      }
+    // Odometer over the outer axes
+    for (size_t axis = R - 1; axis-- > 0;) {
+      p += v.strides[axis];
+      if (++idx[axis] < v.shape[axis])
+        break;
+      p -= (ptrdiff_t)idx[axis] * v.strides[axis];
+      idx[axis] = 0;
+    }
+  }
+  return used == 0 || out.write(chunk, used) == used;
+}
+
+#ifdef REQUEST_H_
+#if REQUEST_MODE == 0 // HTTP
+/* Make a request with the encoded v as its body and return response header.
+ *
+ * @param `method` must be in all caps.
+ * @returns 0 if request fails otherwise the http code.
+ */
+template <typename V>
+int http_request_ndarray(const V &v, ndarray_format format,
+                         NETWORK_CLIENT &client, String method,
+                         String base_url, String path, int port,
+                         String additional_headers) {
+  if (!NETWORK_CONNECT(client, base_url.c_str(), port))
+    return 0;
+
+  String request = _http_head(
+      method, base_url, path, additional_headers,
+      format == NDARRAY_CBOR ? "application/cbor" : "application/octet-stream",
+      (long)ndarray_encoded_size(v, format));
+  request.concat("\n");
+
+  DBG("Outgoing request:\n");
+  DBG(request);
+  client.print(request);
+  if (!ndarray_write(client, v, format)) {
+    DBG("Outgoing request failed\n");
+    NETWORK_STOP(client);
+    return 0;
+  }
+  DBG("Outgoing request finished\n");
+
+  return _http_response(client);
+}
+#define REQUEST_SEND_NDARRAY(client, v, format)                                \
+  (0 != http_request_ndarray(v, format, *client, String(REQUEST_METHOD),       \
+                             String(REQUEST_URL), "/" + String(REQUEST_PATH),  \
+                             REQUEST_PORT, String(REQUEST_HEADERS)))
+
+#elif REQUEST_MODE == 1 // MQTT
+template <typename V>
+bool mqtt_publish_ndarray(PubSubClient &client, const char *topic, const V &v,
+                          ndarray_format format) {
+  if (!client.beginPublish(topic, ndarray_encoded_size(v, format), false))
+    return false;
+  const bool is_ok = ndarray_write(client, v, format);
+  return client.endPublish() && is_ok;
+}
+#define REQUEST_SEND_NDARRAY(client, v, format)                                \
+  mqtt_publish_ndarray(client, REQUEST_PATH, v, format)
+
+#endif // REQUEST_MODE
+#endif // REQUEST_H_
+
+#endif // NDARRAY_SERIAL_H_
@@ -0,0 +1,551 @@
+// Sparse Matrices for Multi-dimensional Array Module
+//
+// M x N matrices storing only their nonzero elements, for sensor grids that
+// are mostly zeros (presence mats, sparse touch or event grids), in two
+// formats with a compile-time capacity of NNZ nonzeros:
+// - ndarray_coo: The (row, column, value) of every nonzero in any order.
+//   Elements can be set and cleared one at a time, so it is the format to
+//   collect events in.
+// - ndarray_csr: Compressed sparse rows, the nonzeros in row-major order with
+//   the offset of the first one of each row. Multiplications walk it row by
+//   row without any search.
+// Both keep their arrays inside the object (no heap) and use the smallest
+// unsigned integers that can hold the indices (uint8_t for up to 255 rows,
+// columns or nonzeros), so the memory and the encoded size grow with NNZ
+// instead of M x N. A 32 x 32 float grid is 4096 bytes dense and 356 bytes as
+// an ndarray_csr<float, 32, 32, 64>.
+//
+// Like ndarray, a(i, j) reads any element (0 when it is not stored), but by
+// value since the zeros do not exist in memory.
+//
+// Depends on ndarray.h and ndarray_ops.h (SIMD of the dense rows of
+// ndarray_gemm). When imported after ndarray_serial.h, it also defines
+// ndarray_write for the sparse matrices (and so REQUEST_SEND_NDARRAY).
+//
+// Defines the following for the user:
+// - ndarray_coo<T, M, N, NNZ>: Unordered nonzeros.
+//   - a.rows[k], a.cols[k], a.values[k]: The k-th nonzero, k < a.nnz().
+//   - a.set(i, j, x): Sets the element at (i, j), setting it to 0 removes it.
+//     Returns false if x is not 0 and the matrix is full (O(nnz)).
+// - ndarray_csr<T, M, N, NNZ>: Row-major nonzeros.
+//   - a.offsets[i]: Index of the first nonzero of row i (a.offsets[M] is
+//     a.nnz()), the nonzeros of row i are [a.offsets[i], a.offsets[i + 1]).
+//   - a.cols[k], a.values[k]: Column (increasing within a row) and value of
+//     the k-th nonzero.
+//   - a.append(i, j, x): Stores x at (i, j) after all the stored nonzeros (in
+//     row-major order), returns false if full or out of order (O(M)).
+// - For both:
+//   - a::rank, a::size, a::capacity, a.dim(axis): 2, M x N, NNZ and M or N.
+//   - a.nnz(): Number of stored nonzeros.
+//   - a(i, j): Value of the element at (i, j).
+//   - a.find(i, j): Pointer to the stored element at (i, j), NULL if it is 0.
+//   - a.clear(): Sets every element to 0.
+// - ndarray_copy(a, v): Stores the nonzeros of the 2D view v in a, returns
+//   false if they do not fit (a is then left empty) or the shape differs.
+// - ndarray_copy(v, a): Writes a (zeros included) into the 2D view v.
+// - ndarray_copy(a, b): Converts between the formats (same return as above).
+// - ndarray_for_each(a, fn): Calls fn(value) on every stored value.
+// - ndarray_gemv(y, a, x), ndarray_gemm(c, a, b): Same as ndarray_gemm.h
+//   for a sparse a and dense views (true as the last argument accumulates).
+// - ndarray_encoded_size(a, format), ndarray_write(out, a, format): Same as
+//   ndarray_serial.h. NDARRAY_RAW writes M and N as 4 byte little-endian
+//   integers, NDARRAY_CBOR an array of [M, N], then both write the index
+//   arrays (a.rows or a.offsets, and a.cols) and a.values as 1D arrays.
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+// #include "ndarray_sparse.h"
+//
+// NDARRAY_INIT(float, pressure, 32, 32);
+// NDARRAY_INIT(float, weights, 32, 4);
+// NDARRAY_INIT(float, features, 32, 4);
+// ndarray_csr<float, 32, 32, 64> active;
+//
+// void loop() {
+//   // ... fill pressure (mostly 0)
+//   if (!ndarray_copy(active, pressure.view()))
+//     return; // more than 64 pressed cells
+//   ndarray_gemm(features.view(), active, weights.view());
+// }
+// ```
+
+#ifndef NDARRAY_SPARSE_H_
+#define NDARRAY_SPARSE_H_
+
+#include "ndarray.h"
+#include "ndarray_ops.h"
+#include <stdint.h>
+
+// Helpers
+// Smallest unsigned integer holding 0 to N
+template <size_t N, bool B8 = (N <= 0xff), bool B16 = (N <= 0xffff)>
+struct _nd_index {
+  static_assert(N <= 0xffffffff, "ndarray sparse indices are 32 bit");
+  typedef uint32_t type;
+};
+template <size_t N, bool B16> struct _nd_index<N, true, B16> {
+  typedef uint8_t type;
+};
+template <size_t N> struct _nd_index<N, false, true> {
+  typedef uint16_t type;
+};
+
+// c[j sc] += x b[j sb] for j < n
+template <typename T>
+void _nd_sparse_axpy(T *c, ptrdiff_t sc, const T &x, const T *b, ptrdiff_t sb,
+                     size_t n) {
+  for (size_t j = 0; j < n; j++)
+    c[(ptrdiff_t)j * sc] = c[(ptrdiff_t)j * sc] + x * b[(ptrdiff_t)j * sb];
+}
+
+#if defined(_ND_LANES)
+inline void _nd_sparse_axpy(float *c, ptrdiff_t sc, const float &x,
+                            const float *b, ptrdiff_t sb, size_t n) {
+  size_t j = 0;
+  if (sc == 1 && sb == 1) {
+    const _ND_VF vx = _ND_VSET1(x);
+    for (; j + _ND_LANES <= n; j += _ND_LANES)
+      _ND_VSTORE(c + j, _ND_VFMA(vx, _ND_VLOAD(b + j), _ND_VLOAD(c + j)));
+  }
+  for (c += (ptrdiff_t)j * sc, b += (ptrdiff_t)j * sb; j < n;
+       j++, c += sc, b += sb)
+    *c += x * *b;
+}
+#endif // _ND_LANES
+
+template <typename T, size_t R>
+void _nd_sparse_zero(const ndarray_view<T, R> &v) {
+  ndarray_for_each(v, [](T &x) { x = T(0); });
+}
+
+// Program
+template <typename T, size_t M, size_t N, size_t NNZ> struct ndarray_coo {
+  static_assert(M > 0 && N > 0 && NNZ > 0,
+                "ndarray_coo needs a shape and a capacity");
+  typedef typename _nd_index<M - 1>::type row_type;
+  typedef typename _nd_index<N - 1>::type col_type;
+
+  static constexpr size_t rank = 2;
+  static constexpr size_t size = M * N;
+  static constexpr size_t capacity = NNZ;
+
+  row_type rows[NNZ];
+  col_type cols[NNZ];
+  T values[NNZ];
+  size_t count;
+
+  ndarray_coo() : count(0) {}
+
+  static constexpr size_t dim(size_t axis) { return axis == 0 ? M : N; }
+  size_t nnz() const { return count; }
+  void clear() { count = 0; }
+
+  T *find(size_t i, size_t j) {
+    for (size_t k = 0; k < count; k++)
+      if (rows[k] == i && cols[k] == j)
+        return &values[k];
+    return NULL;
+  }
+  const T *find(size_t i, size_t j) const {
+    return const_cast<ndarray_coo *>(this)->find(i, j);
+  }
+  T operator()(size_t i, size_t j) const {
+    const T *x = find(i, j);
+    return x == NULL ? T(0) : *x;
+  }
+
+  bool set(size_t i, size_t j, const T &x) {
+    T *p = find(i, j);
+    if (p != NULL) {
+      if (x == T(0)) { // the last nonzero takes its place
+        const size_t k = (size_t)(p - values);
+        count--;
+        rows[k] = rows[count];
+        cols[k] = cols[count];
+        values[k] = values[count];
+      } else
+        *p = x;
+      return true;
+    }
+    if (x == T(0))
+      return true;
+    if (count == NNZ)
+      return false;
+    rows[count] = (row_type)i;
+    cols[count] = (col_type)j;
+    values[count++] = x;
+    return true;
+  }
+};
+
+template <typename T, size_t M, size_t N, size_t NNZ>
+constexpr size_t ndarray_coo<T, M, N, NNZ>::rank;
+template <typename T, size_t M, size_t N, size_t NNZ>
+constexpr size_t ndarray_coo<T, M, N, NNZ>::size;
+template <typename T, size_t M, size_t N, size_t NNZ>
+constexpr size_t ndarray_coo<T, M, N, NNZ>::capacity;
+
+template <typename T, size_t M, size_t N, size_t NNZ> struct ndarray_csr {
+  static_assert(M > 0 && N > 0 && NNZ > 0,
+                "ndarray_csr needs a shape and a capacity");
+  typedef typename _nd_index<NNZ>::type offset_type;
+  typedef typename _nd_index<N - 1>::type col_type;
+
+  static constexpr size_t rank = 2;
+  static constexpr size_t size = M * N;
+  static constexpr size_t capacity = NNZ;
+
+  offset_type offsets[M + 1];
+  col_type cols[NNZ];
+  T values[NNZ];
+
+  ndarray_csr() : offsets() {}
+
+  static constexpr size_t dim(size_t axis) { return axis == 0 ? M : N; }
+  size_t nnz() const { return offsets[M]; }
+  void clear() {
+    for (size_t i = 0; i <= M; i++)
+      offsets[i] = 0;
+  }
+
+  // Binary search of the columns of row i
+  T *find(size_t i, size_t j) {
+    size_t lo = offsets[i], hi = offsets[i + 1];
+    while (lo < hi) {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (cols[mid] < j)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo < offsets[i + 1] && cols[lo] == j ? &values[lo] : NULL;
+  }
+  const T *find(size_t i, size_t j) const {
+    return const_cast<ndarray_csr *>(this)->find(i, j);
+  }
+  T operator()(size_t i, size_t j) const {
+    const T *x = find(i, j);
+    return x == NULL ? T(0) : *x;
+  }
+
+  bool append(size_t i, size_t j, const T &x) {
+    const size_t k = offsets[M];
+    // Nothing stored after row i, and only columns before j in it
+    if (k == NNZ || offsets[i + 1] != k ||
+        (offsets[i] != k && cols[k - 1] >= j))
+      return false;
+    cols[k] = (col_type)j;
+    values[k] = x;
+    for (size_t r = i + 1; r <= M; r++)
+      offsets[r]++;
+    return true;
+  }
+};
+
+template <typename T, size_t M, size_t N, size_t NNZ>
+constexpr size_t ndarray_csr<T, M, N, NNZ>::rank;
+template <typename T, size_t M, size_t N, size_t NNZ>
+constexpr size_t ndarray_csr<T, M, N, NNZ>::size;
+template <typename T, size_t M, size_t N, size_t NNZ>
+constexpr size_t ndarray_csr<T, M, N, NNZ>::capacity;
+
+template <typename T, size_t M, size_t N, size_t NNZ, typename F>
+void ndarray_for_each(ndarray_coo<T, M, N, NNZ> &a, F fn) {
+  for (size_t k = 0; k < a.nnz(); k++)
+    fn(a.values[k]);
+}
+
+template <typename T, size_t M, size_t N, size_t NNZ, typename F>
+void ndarray_for_each(ndarray_csr<T, M, N, NNZ> &a, F fn) {
+  for (size_t k = 0; k < a.nnz(); k++)
+    fn(a.values[k]);
+}
+
+// Conversions
+template <typename T, size_t M, size_t N, size_t NNZ>
+bool ndarray_copy(ndarray_coo<T, M, N, NNZ> &a,
+                  const ndarray_view<const typename _nd_id<T>::type, 2> &v) {
+  a.clear();
+  if (v.shape[0] != M || v.shape[1] != N)
+    return false;
+  for (size_t i = 0; i < M; i++)
+    for (size_t j = 0; j < N; j++) {
+      const T &x = v(i, j);
+      if (x == T(0))
+        continue;
+      if (a.count == NNZ) {
+        a.clear();
+        return false;
+      }
+      a.rows[a.count] = (typename ndarray_coo<T, M, N, NNZ>::row_type)i;
+      a.cols[a.count] = (typename ndarray_coo<T, M, N, NNZ>::col_type)j;
+      a.values[a.count++] = x;
+    }
+  return true;
+}
+
+template <typename T, size_t M, size_t N, size_t NNZ>
+bool ndarray_copy(ndarray_csr<T, M, N, NNZ> &a,
+                  const ndarray_view<const typename _nd_id<T>::type, 2> &v) {
+  a.clear();
+  if (v.shape[0] != M || v.shape[1] != N)
+    return false;
+  size_t k = 0;
+  for (size_t i = 0; i < M; i++) {
+    a.offsets[i] = (typename ndarray_csr<T, M, N, NNZ>::offset_type)k;
+    for (size_t j = 0; j < N; j++) {
+      const T &x = v(i, j);
+      if (x == T(0))
+        continue;
+      if (k == NNZ) {
+        a.clear();
+        return false;
+      }
+      a.cols[k] = (typename ndarray_csr<T, M, N, NNZ>::col_type)j;
+      a.values[k++] = x;
+    }
+  }
+  a.offsets[M] = (typename ndarray_csr<T, M, N, NNZ>::offset_type)k;
+  return true;
+}
+
+template <typename T, size_t M, size_t N, size_t NNZ>
+bool ndarray_copy(const ndarray_view<T, 2> &v,
+                  const ndarray_coo<typename _nd_unconst<T>::type, M, N, NNZ>
+                      &a) {
+  if (v.shape[0] != M || v.shape[1] != N)
+    return false;
+  _nd_sparse_zero(v);
+  for (size_t k = 0; k < a.nnz(); k++)
+    v(a.rows[k], a.cols[k]) = a.values[k];
+  return true;
+}
+
+template <typename T, size_t M, size_t N, size_t NNZ>
+bool ndarray_copy(const ndarray_view<T, 2> &v,
+                  const ndarray_csr<typename _nd_unconst<T>::type, M, N, NNZ>
+                      &a) {
+  if (v.shape[0] != M || v.shape[1] != N)
+    return false;
+  _nd_sparse_zero(v);
+  for (size_t i = 0; i < M; i++)
+    for (size_t k = a.offsets[i]; k < a.offsets[i + 1]; k++)
+      v(i, a.cols[k]) = a.values[k];
+  return true;
+}
+
+template <typename T, size_t M, size_t N, size_t NNZ, size_t NNZ2>
+bool ndarray_copy(ndarray_coo<T, M, N, NNZ> &a,
+                  const ndarray_csr<T, M, N, NNZ2> &b) {
+  a.clear();
+  if (b.nnz() > NNZ)
+    return false;
+  for (size_t i = 0; i < M; i++)
+    for (size_t k = b.offsets[i]; k < b.offsets[i + 1]; k++) {
+      a.rows[a.count] = (typename ndarray_coo<T, M, N, NNZ>::row_type)i;
+      a.cols[a.count] = b.cols[k];
+      a.values[a.count++] = b.values[k];
+    }
+  return true;
+}
+
+// Counting sort by row, then insertion sort of the (short) rows by column
+template <typename T, size_t M, size_t N, size_t NNZ, size_t NNZ2>
+bool ndarray_copy(ndarray_csr<T, M, N, NNZ> &a,
+                  const ndarray_coo<T, M, N, NNZ2> &b) {
+  typedef typename ndarray_csr<T, M, N, NNZ>::offset_type offset_type;
+  a.clear();
+  if (b.nnz() > NNZ)
+    return false;
+  for (size_t k = 0; k < b.nnz(); k++)
+    a.offsets[b.rows[k] + 1]++;
+  for (size_t i = 0; i < M; i++)
+    a.offsets[i + 1] = (offset_type)(a.offsets[i + 1] + a.offsets[i]);
+  // offsets[i] is used as the next free slot of row i, then shifted back
+  for (size_t k = 0; k < b.nnz(); k++) {
+    const size_t slot = a.offsets[b.rows[k]]++;
+    a.cols[slot] = b.cols[k];
+    a.values[slot] = b.values[k];
+  }
+  for (size_t i = M; i > 0; i--)
+    a.offsets[i] = a.offsets[i - 1];
+  a.offsets[0] = 0;
+  for (size_t i = 0; i < M; i++)
+    for (size_t k = a.offsets[i] + 1; k < a.offsets[i + 1]; k++)
+      for (size_t l = k; l > a.offsets[i] && a.cols[l - 1] > a.cols[l]; l--) {
+        const typename ndarray_csr<T, M, N, NNZ>::col_type c = a.cols[l];
+        const T x = a.values[l];
+        a.cols[l] = a.cols[l - 1];
+        a.values[l] = a.values[l - 1];
+        a.cols[l - 1] = c;
+        a.values[l - 1] = x;
+      }
+  return true;
+}
+
+// Products
+template <typename T, size_t M, size_t N, size_t NNZ>
+bool ndarray_gemv(const ndarray_view<T, 1> &y,
+                  const ndarray_csr<T, M, N, NNZ> &a,
+                  const ndarray_view<const typename _nd_id<T>::type, 1> &x,
+                  bool accumulate = false) {
+  if (y.shape[0] != M || x.shape[0] != N)
+    return false;
+  for (size_t i = 0; i < M; i++) {
+    T acc = T(0);
+    for (size_t k = a.offsets[i]; k < a.offsets[i + 1]; k++)
+      acc = acc + a.values[k] * x.data[(ptrdiff_t)a.cols[k] * x.strides[0]];
+    T &out = y.data[(ptrdiff_t)i * y.strides[0]];
+    out = accumulate ? out + acc : acc;
+  }
+  return true;
+}
+
+template <typename T, size_t M, size_t N, size_t NNZ>
+bool ndarray_gemv(const ndarray_view<T, 1> &y,
+                  const ndarray_coo<T, M, N, NNZ> &a,
+                  const ndarray_view<const typename _nd_id<T>::type, 1> &x,
+                  bool accumulate = false) {
+  if (y.shape[0] != M || x.shape[0] != N)
+    return false;
+  if (!accumulate)
+    _nd_sparse_zero(y);
+  for (size_t k = 0; k < a.nnz(); k++) {
+    T &out = y.data[(ptrdiff_t)a.rows[k] * y.strides[0]];
+    out = out + a.values[k] * x.data[(ptrdiff_t)a.cols[k] * x.strides[0]];
+  }
+  return true;
+}
+
+// Row i of c gets a_ij times row j of b for every nonzero a_ij
+template <typename T, size_t M, size_t N, size_t NNZ>
+bool ndarray_gemm(const ndarray_view<T, 2> &c,
+                  const ndarray_csr<T, M, N, NNZ> &a,
+                  const ndarray_view<const typename _nd_id<T>::type, 2> &b,
+                  bool accumulate = false) {
+  const size_t n = c.shape[1];
+  if (c.shape[0] != M || b.shape[0] != N || b.shape[1] != n)
+    return false;
+  if (!accumulate)
+    _nd_sparse_zero(c);
+  for (size_t i = 0; i < M; i++)
+    for (size_t k = a.offsets[i]; k < a.offsets[i + 1]; k++)
+      _nd_sparse_axpy(c.data + (ptrdiff_t)i * c.strides[0], c.strides[1],
+                      a.values[k],
+                      b.data + (ptrdiff_t)a.cols[k] * b.strides[0],
+                      b.strides[1], n);
+  return true;
+}
+
+template <typename T, size_t M, size_t N, size_t NNZ>
+bool ndarray_gemm(const ndarray_view<T, 2> &c,
+                  const ndarray_coo<T, M, N, NNZ> &a,
+                  const ndarray_view<const typename _nd_id<T>::type, 2> &b,
+                  bool accumulate = false) {
+  const size_t n = c.shape[1];
+  if (c.shape[0] != M || b.shape[0] != N || b.shape[1] != n)
+    return false;
+  if (!accumulate)
+    _nd_sparse_zero(c);
+  for (size_t k = 0; k < a.nnz(); k++)
+    _nd_sparse_axpy(c.data + (ptrdiff_t)a.rows[k] * c.strides[0],
+                    c.strides[1], a.values[k],
+                    b.data + (ptrdiff_t)a.cols[k] * b.strides[0],
+                    b.strides[1], n);
+  return true;
+}
+
+#ifdef NDARRAY_SERIAL_H_
+// Writes the [M, N] head into h, returns its length
+inline size_t _nd_sparse_header(uint8_t *h, size_t m, size_t n,
+                                ndarray_format format) {
+  size_t len = 0;
+  if (format == NDARRAY_RAW) {
+    for (size_t i = 0; i < 4; i++)
+      h[len++] = (uint8_t)(m >> (8 * i));
+    for (size_t i = 0; i < 4; i++)
+      h[len++] = (uint8_t)(n >> (8 * i));
+    return len;
+  }
+  len += _nd_cbor_head(h + len, 4, 4); // [[M, N], indices, cols, values]
+  len += _nd_cbor_head(h + len, 4, 2);
+  len += _nd_cbor_head(h + len, 0, m);
+  len += _nd_cbor_head(h + len, 0, n);
+  return len;
+}
+
+template <typename A, typename B, typename C>
+size_t _nd_sparse_encoded_size(size_t m, size_t n,
+                               const ndarray_view<A, 1> &indices,
+                               const ndarray_view<B, 1> &cols,
+                               const ndarray_view<C, 1> &values,
+                               ndarray_format format) {
+  uint8_t h[22];
+  return _nd_sparse_header(h, m, n, format) +
+         ndarray_encoded_size(indices, format) +
+         ndarray_encoded_size(cols, format) +
+         ndarray_encoded_size(values, format);
+}
+
+template <typename Out, typename A, typename B, typename C>
+bool _nd_sparse_write(Out &out, size_t m, size_t n,
+                      const ndarray_view<A, 1> &indices,
+                      const ndarray_view<B, 1> &cols,
+                      const ndarray_view<C, 1> &values,
+                      ndarray_format format) {
+  uint8_t h[22];
+  const size_t len = _nd_sparse_header(h, m, n, format);
+  return out.write(h, len) == len && ndarray_write(out, indices, format) &&
+         ndarray_write(out, cols, format) &&
+         ndarray_write(out, values, format);
+}
+
+template <typename T, size_t M, size_t N, size_t NNZ>
+size_t ndarray_encoded_size(const ndarray_coo<T, M, N, NNZ> &a,
+                            ndarray_format format) {
+  return _nd_sparse_encoded_size(
+      M, N, ndarray_view<const typename ndarray_coo<T, M, N, NNZ>::row_type,
+                         1>(a.rows, a.nnz()),
+      ndarray_view<const typename ndarray_coo<T, M, N, NNZ>::col_type, 1>(
+          a.cols, a.nnz()),
+      ndarray_view<const T, 1>(a.values, a.nnz()), format);
+}
+
+template <typename Out, typename T, size_t M, size_t N, size_t NNZ>
+bool ndarray_write(Out &out, const ndarray_coo<T, M, N, NNZ> &a,
+                   ndarray_format format) {
+  return _nd_sparse_write(
+      out, M, N,
+      ndarray_view<const typename ndarray_coo<T, M, N, NNZ>::row_type, 1>(
+          a.rows, a.nnz()),
+      ndarray_view<const typename ndarray_coo<T, M, N, NNZ>::col_type, 1>(
+          a.cols, a.nnz()),
+      ndarray_view<const T, 1>(a.values, a.nnz()), format);
+}
+
+template <typename T, size_t M, size_t N, size_t NNZ>
+size_t ndarray_encoded_size(const ndarray_csr<T, M, N, NNZ> &a,
+                            ndarray_format format) {
+  return _nd_sparse_encoded_size(
+      M, N, ndarray_view<const typename ndarray_csr<T, M, N, NNZ>::offset_type,
+                         1>(a.offsets, M + 1),
+      ndarray_view<const typename ndarray_csr<T, M, N, NNZ>::col_type, 1>(
+          a.cols, a.nnz()),
+      ndarray_view<const T, 1>(a.values, a.nnz()), format);
+}
+
+template <typename Out, typename T, size_t M, size_t N, size_t NNZ>
+bool ndarray_write(Out &out, const ndarray_csr<T, M, N, NNZ> &a,
+                   ndarray_format format) {
+  return _nd_sparse_write(
+      out, M, N,
+      ndarray_view<const typename ndarray_csr<T, M, N, NNZ>::offset_type, 1>(
+          a.offsets, M + 1),
+      ndarray_view<const typename ndarray_csr<T, M, N, NNZ>::col_type, 1>(
+          a.cols, a.nnz()),
+      ndarray_view<const T, 1>(a.values, a.nnz()), format);
+}
+#endif // NDARRAY_SERIAL_H_
+
+#endif // NDARRAY_SPARSE_H_
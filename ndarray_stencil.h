@@ -0,0 +1,199 @@
+// Stencil and Convolution for Multi-dimensional Array Module
+//
+// 1D (FIR filtering of signals) and 2D (image or sensor grid) stencils with a
+// kernel whose size is known at compile-time, so the loops over it unroll. The
+// output has the shape of the input and the kernel is centered on each
+// element (its element K / 2 is over it).
+//
+// Elements whose kernel fits inside the input (the interior) are computed by
+// a loop without any boundary check; only the K / 2 wide border runs the
+// boundary handling, where the elements outside of the input are read as:
+// - NDARRAY_ZERO: 0.
+// - NDARRAY_CLAMP: The nearest element of the input.
+// - NDARRAY_WRAP: The input repeated periodically.
+// Interior rows of float views with contiguous rows use the SIMD vectors of
+// ndarray_ops.h, any other strides fall back to a scalar strided loop.
+//
+// Depends on ndarray.h and ndarray_ops.h. The output must not overlap the
+// input.
+//
+// Defines the following for the user:
+// - NDARRAY_ZERO, NDARRAY_CLAMP, NDARRAY_WRAP: Boundary modes
+//   (ndarray_boundary).
+// - ndarray_stencil(out, in, w, mode): out_i = sum_k w_k in_{i + k - K/2} for
+//   the 1D in/out and the T[K] array w, and likewise for 2D in/out and a
+//   T[KH][KW] array w (a correlation, the default mode is NDARRAY_ZERO).
+// - ndarray_convolve(out, in, w, mode): Same as ndarray_stencil with w flipped
+//   (the convolution, e.g. an FIR filter with taps w).
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+// #include "ndarray_stencil.h"
+//
+// NDARRAY_INIT(float, thermal, 24, 32);  // thermal camera frame
+// NDARRAY_INIT(float, smoothed, 24, 32);
+// const float blur[3][3] = {{1 / 16.f, 2 / 16.f, 1 / 16.f},
+//                           {2 / 16.f, 4 / 16.f, 2 / 16.f},
+//                           {1 / 16.f, 2 / 16.f, 1 / 16.f}};
+//
+// void loop() {
+//   // ... fill thermal
+//   ndarray_stencil(smoothed.view(), thermal.view(), blur, NDARRAY_CLAMP);
+// }
+// ```
+
+#ifndef NDARRAY_STENCIL_H_
+#define NDARRAY_STENCIL_H_
+
+#include "ndarray.h"
+#include "ndarray_ops.h"
+
+// Boundary modes
+enum ndarray_boundary { NDARRAY_ZERO, NDARRAY_CLAMP, NDARRAY_WRAP };
+
+// Helpers
+// Index i of an axis of n elements after the boundary mode, -1 for a zero
+inline ptrdiff_t _nd_boundary(ptrdiff_t i, size_t n, ndarray_boundary mode) {
+  if (i >= 0 && i < (ptrdiff_t)n)
+    return i;
+  if (mode == NDARRAY_CLAMP)
+    return i < 0 ? 0 : (ptrdiff_t)n - 1;
+  if (mode == NDARRAY_WRAP) {
+    const ptrdiff_t m = i % (ptrdiff_t)n;
+    return m < 0 ? m + (ptrdiff_t)n : m;
+  }
+  return -1;
+}
+
+// o[j so] = sum_r,k w[r KW + k] rows[r][(j + k) s] for j < n
+template <size_t KH, size_t KW, typename T>
+void _nd_stencil_rows(T *o, ptrdiff_t so, const T *const *rows, ptrdiff_t s,
+                      const T *w, size_t n) {
+  for (size_t j = 0; j < n; j++) {
+    T acc = T(0);
+    for (size_t r = 0; r < KH; r++)
+      for (size_t k = 0; k < KW; k++)
+        acc = acc + w[r * KW + k] * rows[r][(ptrdiff_t)(j + k) * s];
+    o[(ptrdiff_t)j * so] = acc;
+  }
+}
+
+#if defined(_ND_LANES)
+template <size_t KH, size_t KW>
+void _nd_stencil_rows(float *o, ptrdiff_t so, const float *const *rows,
+                      ptrdiff_t s, const float *w, size_t n) {
+  size_t j = 0;
+  if (so == 1 && s == 1)
+    for (; j + _ND_LANES <= n; j += _ND_LANES) {
+      _ND_VF acc = _ND_VSET1(0);
+      for (size_t r = 0; r < KH; r++)
+        for (size_t k = 0; k < KW; k++)
+          acc = _ND_VFMA(_ND_VSET1(w[r * KW + k]), _ND_VLOAD(rows[r] + j + k),
+                         acc);
+      _ND_VSTORE(o + j, acc);
+    }
+  for (; j < n; j++) {
+    float acc = 0;
+    for (size_t r = 0; r < KH; r++)
+      for (size_t k = 0; k < KW; k++)
+        acc += w[r * KW + k] * rows[r][(ptrdiff_t)(j + k) * s];
+    o[(ptrdiff_t)j * so] = acc;
+  }
+}
+#endif // _ND_LANES
+
+// out(i, j) with the boundary mode for the kernel elements outside of in
+template <size_t KH, size_t KW, typename T>
+T _nd_stencil_at(const ndarray_view<const T, 2> &in, const T *w, size_t i,
+                 size_t j, ndarray_boundary mode) {
+  T acc = T(0);
+  for (size_t r = 0; r < KH; r++) {
+    const ptrdiff_t ii =
+        _nd_boundary((ptrdiff_t)(i + r) - (ptrdiff_t)(KH / 2), in.shape[0],
+                     mode);
+    if (ii < 0)
+      continue;
+    for (size_t k = 0; k < KW; k++) {
+      const ptrdiff_t jj = _nd_boundary(
+          (ptrdiff_t)(j + k) - (ptrdiff_t)(KW / 2), in.shape[1], mode);
+      if (jj >= 0)
+        acc = acc + w[r * KW + k] *
+                        in.data[ii * in.strides[0] + jj * in.strides[1]];
+    }
+  }
+  return acc;
+}
+
+template <size_t KH, size_t KW, typename T>
+void _nd_stencil(const ndarray_view<T, 2> &out,
+                 const ndarray_view<const T, 2> &in, const T *w,
+                 ndarray_boundary mode) {
+  const size_t h = in.shape[0], wd = in.shape[1];
+  const size_t r0 = KH / 2, r1 = KH - 1 - r0, c0 = KW / 2, c1 = KW - 1 - c0;
+  // Interior [i0, i1) x [j0, j1), empty when the kernel is larger than in
+  const size_t i0 = r0 < h ? r0 : h, i1 = h > i0 + r1 ? h - r1 : i0;
+  const size_t j0 = c0 < wd ? c0 : wd, j1 = wd > j0 + c1 ? wd - c1 : j0;
+
+  for (size_t i = 0; i < h; i++) {
+    T *o = out.data + (ptrdiff_t)i * out.strides[0];
+    const ptrdiff_t so = out.strides[1];
+    if (i < i0 || i >= i1) {
+      for (size_t j = 0; j < wd; j++)
+        o[(ptrdiff_t)j * so] = _nd_stencil_at<KH, KW>(in, w, i, j, mode);
+      continue;
+    }
+    for (size_t j = 0; j < j0; j++)
+      o[(ptrdiff_t)j * so] = _nd_stencil_at<KH, KW>(in, w, i, j, mode);
+    const T *rows[KH];
+    for (size_t r = 0; r < KH; r++)
+      rows[r] = in.data + (ptrdiff_t)(i - r0 + r) * in.strides[0];
+    _nd_stencil_rows<KH, KW>(o + (ptrdiff_t)j0 * so, so, rows, in.strides[1],
+                             w, j1 - j0);
+    for (size_t j = j1; j < wd; j++)
+      o[(ptrdiff_t)j * so] = _nd_stencil_at<KH, KW>(in, w, i, j, mode);
+  }
+}
+
+// Program
+template <typename T, size_t K>
+void ndarray_stencil(const ndarray_view<T, 1> &out,
+                     const ndarray_view<const typename _nd_id<T>::type, 1> &in,
+                     const typename _nd_id<T>::type (&w)[K],
+                     ndarray_boundary mode = NDARRAY_ZERO) {
+  _nd_stencil<1, K>(ndarray_unsqueeze(out, 0), ndarray_unsqueeze(in, 0), w,
+                    mode);
+}
+
+template <typename T, size_t KH, size_t KW>
+void ndarray_stencil(const ndarray_view<T, 2> &out,
+                     const ndarray_view<const typename _nd_id<T>::type, 2> &in,
+                     const typename _nd_id<T>::type (&w)[KH][KW],
+                     ndarray_boundary mode = NDARRAY_ZERO) {
+  _nd_stencil<KH, KW>(out, in, &w[0][0], mode);
+}
+
+template <typename T, size_t K>
+void ndarray_convolve(const ndarray_view<T, 1> &out,
+                      const ndarray_view<const typename _nd_id<T>::type, 1> &in,
+                      const typename _nd_id<T>::type (&w)[K],
+                      ndarray_boundary mode = NDARRAY_ZERO) {
+  T flipped[K];
+  for (size_t k = 0; k < K; k++)
+    flipped[k] = w[K - 1 - k];
+  ndarray_stencil(out, in, flipped, mode);
+}
+
+template <typename T, size_t KH, size_t KW>
+void ndarray_convolve(const ndarray_view<T, 2> &out,
+                      const ndarray_view<const typename _nd_id<T>::type, 2> &in,
+                      const typename _nd_id<T>::type (&w)[KH][KW],
+                      ndarray_boundary mode = NDARRAY_ZERO) {
+  T flipped[KH][KW];
+  for (size_t r = 0; r < KH; r++)
+    for (size_t k = 0; k < KW; k++)
+      flipped[r][k] = w[KH - 1 - r][KW - 1 - k];
+  ndarray_stencil(out, in, flipped, mode);
+}
+
+#endif // NDARRAY_STENCIL_H_
@@ -0,0 +1,170 @@
+// Storage Policies for Multi-dimensional Array Module
+//
+// ndarray is a view: the buffer behind it is declared separately (usually by
+// NDARRAY_INIT as a global). ndarray_buffer<T, Storage, D...> is an ndarray
+// that brings its buffer along, where the buffer comes from the Storage
+// policy picked by template parameter:
+// - ndarray_inline: The elements live inside the object, like a std::array
+//   (on the stack for locals, in .bss for globals).
+// - ndarray_aligned<A>: Same, with the first element aligned to A bytes (16
+//   for SSE/NEON, 32 for AVX, 64 for a cache line), so the SIMD loads of
+//   ndarray_ops.h and ndarray_gemm.h never straddle a cache line at the start
+//   of the buffer.
+// - ndarray_pool<K>: One of K buffers of a static pool (one pool per element
+//   type, shape and K), taken on construction and given back on destruction.
+//   For arrays with a limited lifetime (e.g. a window being processed or
+//   sent) without the heap or a stack large enough for them. The pool is
+//   lock-free and may be used from several threads (not from interrupts).
+// - ndarray_external: A buffer passed to the constructor (same as ndarray).
+// None of them allocates from the heap, and the elements are not initialized
+// (like a C array).
+//
+// An ndarray_buffer is an ndarray<T, D...> (row-major), so it has the whole
+// interface of it (a(i...), a[i], begin(), end(), view(), expressions of
+// ndarray_expr.h). Copying it copies the elements, except for
+// ndarray_external which copies the pointer.
+//
+// Depends on ndarray.h.
+//
+// Defines the following for the user:
+// - ndarray_buffer<T, Storage, D...>: ndarray<T, D...> with its buffer.
+//   - ndarray_buffer(): Takes the buffer from Storage, data is NULL if the
+//     ndarray_pool is exhausted.
+//   - ndarray_buffer(data): Same as ndarray(data) for ndarray_external.
+//   - a.fill(x): Sets every element to x.
+// - ndarray_inline, ndarray_aligned<A>, ndarray_pool<K>, ndarray_external:
+//   The storage policies.
+//
+// Example:
+// ```c
+// #include "ndarray.h"
+// #include "ndarray_ops.h"
+// #include "ndarray_storage.h"
+//
+// typedef ndarray_buffer<float, ndarray_pool<2>, 3, 256> window_t;
+//
+// void process(const float *samples) {
+//   ndarray_buffer<float, ndarray_aligned<32>, 3, 256> scaled; // stack
+//   window_t window; // one of the 2 buffers of the pool
+//   if (window.data == NULL)
+//     return; // both are in use
+//   // ... fill window
+//   ndarray_scale(scaled.view(), window.view(), 0.5f);
+// } // window goes back to the pool
+// ```
+
+#ifndef NDARRAY_STORAGE_H_
+#define NDARRAY_STORAGE_H_
+
+#include "ndarray.h"
+
+// Helpers
+template <typename T, size_t N> struct _nd_copy_n {
+  static void run(T *dst, const T *src) {
+    for (size_t i = 0; i < N; i++)
+      dst[i] = src[i];
+  }
+};
+
+// Program
+struct ndarray_inline {
+  template <typename T, size_t N> struct buffer {
+    T elements[N];
+    T *get() { return elements; }
+  };
+};
+
+template <size_t A> struct ndarray_aligned {
+  static_assert(A > 0 && (A & (A - 1)) == 0,
+                "ndarray_aligned needs a power of two");
+  template <typename T, size_t N> struct buffer {
+    static_assert(A >= alignof(T), "ndarray_aligned is below the alignment "
+                                   "of the element type");
+    alignas(A) T elements[N];
+    T *get() { return elements; }
+  };
+};
+
+template <size_t K> struct ndarray_pool {
+  static_assert(K > 0, "ndarray_pool needs at least one buffer");
+  template <typename T, size_t N> struct buffer {
+    T *elements;
+
+    static T (&slots())[K][N] {
+      static T s[K][N];
+      return s;
+    }
+    static bool (&used())[K] {
+      static bool u[K];
+      return u;
+    }
+
+    buffer() : elements(_acquire()) {}
+    buffer(const buffer &other) : elements(_acquire()) {
+      if (elements != NULL && other.elements != NULL)
+        _nd_copy_n<T, N>::run(elements, other.elements);
+    }
+    buffer &operator=(const buffer &other) {
+      if (elements != NULL && other.elements != NULL && this != &other)
+        _nd_copy_n<T, N>::run(elements, other.elements);
+      return *this;
+    }
+    ~buffer() {
+      if (elements != NULL)
+        __atomic_clear(&used()[(elements - slots()[0]) / N],
+                       __ATOMIC_RELEASE);
+    }
+
+    T *get() { return elements; }
+
+    static T *_acquire() {
+      for (size_t k = 0; k < K; k++)
+        if (!__atomic_test_and_set(&used()[k], __ATOMIC_ACQUIRE))
+          return slots()[k];
+      return NULL;
+    }
+  };
+};
+
+struct ndarray_external {
+  template <typename T, size_t N> struct buffer {
+    T *elements;
+    explicit buffer(T *data) : elements(data) {}
+    T *get() { return elements; }
+  };
+};
+
+// The buffer is a base class initialized before the ndarray pointing into it
+template <typename T, typename Storage, size_t... D>
+struct ndarray_buffer
+    : Storage::template buffer<T, _nd_prod<D...>::value>,
+      ndarray<T, D...> {
+  typedef typename Storage::template buffer<T, _nd_prod<D...>::value>
+      storage_type;
+  typedef ndarray<T, D...> array_type;
+
+  // Default-initialized, the inline elements are not zeroed
+  ndarray_buffer() : array_type(storage_type::get()) {}
+  explicit ndarray_buffer(T *data)
+      : storage_type(data), array_type(storage_type::get()) {}
+  ndarray_buffer(const ndarray_buffer &other)
+      : storage_type(other), array_type(storage_type::get()) {}
+
+  ndarray_buffer &operator=(const ndarray_buffer &other) {
+    storage_type::operator=(other);
+    this->data = storage_type::get();
+    return *this;
+  }
+  template <typename E>
+  const ndarray_buffer &operator=(const _nd_expr<E> &expr) const {
+    array_type::operator=(expr);
+    return *this;
+  }
+
+  void fill(const T &x) {
+    for (size_t i = 0; this->data != NULL && i < array_type::size; i++)
+      this->data[i] = x;
+  }
+};
+
+#endif // NDARRAY_STORAGE_H_
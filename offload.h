@@ -0,0 +1,312 @@
+// Network Offload Module
+//
+// Moves "Dynamic Networking Module" (network.h) and "Dynamic Request Module"
+// (request.h) to a task of their own, so that the loop (e.g. sampling on
+// core 1 of an ESP32) never waits on the network. REQUEST_SEND only copies
+// the message into a lock-free single-producer/single-consumer ring and
+// returns, the task drains the ring with http_request() or client.publish
+// and runs NETWORK_LOOP and REQUEST_LOOP in between:
+// - ESP32: A FreeRTOS task pinned to OFFLOAD_CORE (core 0 next to WiFi by
+//   default, the loop task runs on core 1), woken by a task notification.
+// - Hosts: A std::thread (to stress-test and benchmark the queue on Linux),
+//   woken by a condition variable, a wake-up missed by a race costs
+//   OFFLOAD_IDLE_MS at most.
+//
+// Messages are copied into OFFLOAD_SLOTS slots of OFFLOAD_MESSAGE bytes
+// (nothing is allocated), a message that is too long or that finds the ring
+// full is dropped and counted. REQUEST_SEND must only be called from one task
+// (the producer) and not from interrupts.
+//
+// Define macroes below before importing the header to configure:
+// ```c
+// #define OFFLOAD_SLOTS 8         // optional, messages queued at most, a
+//                                 // power of two (default 8)
+// #define OFFLOAD_MESSAGE 256     // optional, bytes of a message including
+//                                 // the terminating 0 (default 256)
+// #define OFFLOAD_CORE 0          // optional, core of the ESP32 task
+//                                 // (default 0)
+// #define OFFLOAD_STACK 8192      // optional, stack of the ESP32 task
+//                                 // (default 8192)
+// #define OFFLOAD_PRIORITY 1      // optional, priority of the ESP32 task
+//                                 // (default 1)
+// #define OFFLOAD_IDLE_MS 10      // optional, longest sleep of the task
+//                                 // between NETWORK_LOOPs (default 10)
+// #define OFFLOAD_DELIVER(msg) fn(msg) // optional, sends `const char *msg`
+//                                 // and evaluates to whether it was sent
+//                                 // (default the REQUEST_SEND of request.h)
+// ```
+//
+// Depends on "Lock-free Ring Module" (ring.h). Import after network.h and
+// request.h (or define OFFLOAD_DELIVER without them, e.g. for tests on a
+// host).
+//
+// Defines the following for the user:
+// - OFFLOAD_SETUP(client): Starts the task, which runs NETWORK_SETUP() and
+//   REQUEST_SETUP(client) itself (call it instead of these two).
+// - REQUEST_SEND(client, data): Queues data (a String) for the task, returns
+//   false if it was dropped. client is ignored (the task uses the one given
+//   to OFFLOAD_SETUP).
+// - NETWORK_LOOP(), REQUEST_LOOP(client): Do nothing, the task runs them.
+// - offload_send(data), offload_send(msg, len): Same as REQUEST_SEND.
+// - offload_pending(): Number of queued messages.
+// - offload_stats(): offload_counters with the number of queued, dropped,
+//   sent and failed messages.
+// - offload_stop(): Sends what is queued then stops the task (call it before
+//   exiting on hosts).
+//
+// Example:
+// ```c
+// #include "network.h"
+// #include "request.h"
+// #include "offload.h"
+//
+// NETWORK_INIT(network);
+// REQUEST_INIT(network, request);
+//
+// void setup() { OFFLOAD_SETUP(request); }
+//
+// void loop() {
+//   String data = String(analogRead(A0));
+//   if (!REQUEST_SEND(request, data)) // never waits on the network
+//     DBG("Queue full\n");
+//   delay(10);
+// }
+// ```
+
+#ifndef OFFLOAD_H_
+#define OFFLOAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Defaults
+#ifndef OFFLOAD_SLOTS
+#define OFFLOAD_SLOTS 8
+#endif // OFFLOAD_SLOTS
+
+#ifndef OFFLOAD_MESSAGE
+#define OFFLOAD_MESSAGE 256
+#endif // OFFLOAD_MESSAGE
+
+#ifndef OFFLOAD_CORE
+#define OFFLOAD_CORE 0
+#endif // OFFLOAD_CORE
+
+#ifndef OFFLOAD_STACK
+#define OFFLOAD_STACK 8192
+#endif // OFFLOAD_STACK
+
+#ifndef OFFLOAD_PRIORITY
+#define OFFLOAD_PRIORITY 1
+#endif // OFFLOAD_PRIORITY
+
+#ifndef OFFLOAD_IDLE_MS
+#define OFFLOAD_IDLE_MS 10
+#endif // OFFLOAD_IDLE_MS
+
+#if !defined(REQUEST_H_) && !defined(OFFLOAD_DELIVER)
+#error "offload.h needs request.h or OFFLOAD_DELIVER"
+#endif // REQUEST_H_
+
+// Dependecies
+#include "ring.h"
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif // ESP32
+
+// Make DBG macro optional
+#ifndef DBG
+#define DBG(...)
+#endif // DBG
+
+// Counters
+struct offload_counters {
+  uint32_t queued, dropped; // written by the producer
+  uint32_t sent, failed;    // written by the task
+};
+
+// Helpers
+struct _offload_message {
+  char text[OFFLOAD_MESSAGE];
+};
+
+// The messages are sent from their slot, which is released afterwards
+ring_spsc<_offload_message, OFFLOAD_SLOTS> _offload_ring;
+// Each side's counters on its own cache line, next to its index
+struct _offload_state {
+  alignas(RING_CACHE_LINE) uint32_t queued, dropped;
+  alignas(RING_CACHE_LINE) uint32_t sent, failed;
+  bool stop;
+};
+
+_offload_state _offload;
+
+// Single-writer counter, read from the other side
+inline void _offload_count(uint32_t &counter) {
+  __atomic_store_n(&counter, counter + 1, __ATOMIC_RELAXED);
+}
+
+#if defined(REQUEST_H_)
+#if REQUEST_MODE == 0 // HTTP
+NETWORK_CLIENT *_offload_client = NULL;
+#define _OFFLOAD_CLIENT _offload_client
+#define _OFFLOAD_BIND(client) _offload_client = client
+#else // MQTT
+PubSubClient *_offload_client = NULL;
+#define _OFFLOAD_CLIENT (*_offload_client)
+#define _OFFLOAD_BIND(client) _offload_client = &client
+#endif // REQUEST_MODE
+#endif // REQUEST_H_
+
+// The macros of network.h and request.h are redefined below, the task uses
+// the originals
+bool _offload_deliver(const char *msg) {
+#if defined(OFFLOAD_DELIVER)
+  return OFFLOAD_DELIVER(msg);
+#elif REQUEST_MODE == 0
+  const String data = String(msg);
+  return REQUEST_SEND(_OFFLOAD_CLIENT, data);
+#else
+  const bool sent = _offload_client->publish(REQUEST_PATH, msg);
+  DBG("Sent " + String(msg) + " to " + REQUEST_PATH + " topic on " +
+      REQUEST_URL + "\n");
+  return sent;
+#endif // OFFLOAD_DELIVER
+}
+
+void _offload_connect() {
+#if defined(REQUEST_H_)
+  NETWORK_SETUP();
+  REQUEST_SETUP(_OFFLOAD_CLIENT);
+#endif // REQUEST_H_
+}
+
+// Sends what is queued, returns whether the task should stop
+bool _offload_drain() {
+#if defined(REQUEST_H_)
+  NETWORK_LOOP();
+  REQUEST_LOOP(_OFFLOAD_CLIENT);
+#endif // REQUEST_H_
+  // Whatever was queued before the stop is seen below
+  const bool stop = __atomic_load_n(&_offload.stop, __ATOMIC_ACQUIRE);
+  bool sent = false;
+  for (_offload_message *m; (m = _offload_ring.peek()) != NULL; sent = true) {
+    _offload_count(_offload_deliver(m->text) ? _offload.sent
+                                             : _offload.failed);
+    _offload_ring.release();
+  }
+  return stop && !sent;
+}
+
+#if defined(ESP32)
+TaskHandle_t _offload_task = NULL;
+
+void _offload_run(void *) {
+  _offload_connect();
+  while (!_offload_drain())
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OFFLOAD_IDLE_MS));
+  __atomic_store_n(&_offload_task, (TaskHandle_t)NULL, __ATOMIC_RELEASE);
+  vTaskDelete(NULL);
+}
+
+void _offload_start() {
+  xTaskCreatePinnedToCore(_offload_run, "offload", OFFLOAD_STACK, NULL,
+                          OFFLOAD_PRIORITY, &_offload_task, OFFLOAD_CORE);
+}
+
+void _offload_wake() {
+  if (_offload_task != NULL)
+    xTaskNotifyGive(_offload_task);
+}
+
+// Not woken, it may already be deleting itself
+void _offload_join() {
+  while (__atomic_load_n(&_offload_task, __ATOMIC_ACQUIRE) != NULL)
+    vTaskDelay(1);
+}
+#else
+std::thread _offload_thread;
+std::mutex _offload_mutex;
+std::condition_variable _offload_cv;
+
+void _offload_run() {
+  _offload_connect();
+  while (!_offload_drain()) {
+    std::unique_lock<std::mutex> lock(_offload_mutex);
+    _offload_cv.wait_for(
+        lock, std::chrono::milliseconds(OFFLOAD_IDLE_MS), []() {
+          return !_offload_ring.empty() ||
+                 __atomic_load_n(&_offload.stop, __ATOMIC_ACQUIRE);
+        });
+  }
+}
+
+void _offload_start() { _offload_thread = std::thread(_offload_run); }
+void _offload_wake() { _offload_cv.notify_one(); }
+void _offload_join() {
+  _offload_wake();
+  if (_offload_thread.joinable())
+    _offload_thread.join();
+}
+#endif // ESP32
+
+// Program
+bool offload_send(const char *msg, size_t len) {
+  _offload_message *m =
+      len < OFFLOAD_MESSAGE ? _offload_ring.claim() : NULL;
+  if (m == NULL) {
+    _offload_count(_offload.dropped);
+    return false;
+  }
+  memcpy(m->text, msg, len);
+  m->text[len] = '\0';
+  _offload_ring.publish();
+  _offload_count(_offload.queued);
+  _offload_wake();
+  return true;
+}
+
+template <typename S> bool offload_send(const S &data) {
+  return offload_send(data.c_str(), data.length());
+}
+
+uint32_t offload_pending() { return _offload_ring.size(); }
+
+offload_counters offload_stats() {
+  offload_counters c;
+  c.queued = __atomic_load_n(&_offload.queued, __ATOMIC_RELAXED);
+  c.dropped = __atomic_load_n(&_offload.dropped, __ATOMIC_RELAXED);
+  c.sent = __atomic_load_n(&_offload.sent, __ATOMIC_RELAXED);
+  c.failed = __atomic_load_n(&_offload.failed, __ATOMIC_RELAXED);
+  return c;
+}
+
+void offload_stop() {
+  __atomic_store_n(&_offload.stop, true, __ATOMIC_RELEASE);
+  _offload_join();
+  __atomic_store_n(&_offload.stop, false, __ATOMIC_RELAXED);
+}
+
+#if defined(REQUEST_H_)
+#define OFFLOAD_SETUP(client)                                                  \
+  _OFFLOAD_BIND(client);                                                       \
+  _offload_start()
+#else
+#define OFFLOAD_SETUP(client) _offload_start()
+#endif // REQUEST_H_
+
+#undef REQUEST_SEND
+#define REQUEST_SEND(client, data) offload_send(data)
+#undef REQUEST_LOOP
+#define REQUEST_LOOP(client)
+#undef NETWORK_LOOP
+#define NETWORK_LOOP()
+
+#endif // OFFLOAD_H_
@@ -0,0 +1,274 @@
+// Pipeline Module
+//
+// The usual flow of a sketch (sample a sensor, buffer the samples, format a
+// batch of them, REQUEST_SEND it) as a pipeline of four stages with bounded
+// buffers between them:
+// - source: `bool fn(T &sample)` called once per run() (false when there is
+//   no sample), or samples pushed with push() from an interrupt or another
+//   task (a ring_spsc of "Lock-free Ring Module" (ring.h) of N samples).
+// - window: Collects the samples into a batch of B, or fewer when window_ms
+//   ms passed since its first sample.
+// - encode: `size_t fn(const T *batch, size_t n, char *out, size_t cap)`
+//   turns a batch into a message of at most M - 1 bytes and returns its
+//   length (0 if it does not fit, which drops the batch). pipeline_csv
+//   (default) and pipeline_delta_csv (compresses slowly changing integer
+//   samples) are defined below, binary encodings (e.g. ndarray_serial.h) fit
+//   as well.
+// - sink: `bool fn(const char *msg, size_t len)` sends the message and
+//   returns false when it could not (e.g. the queue of offload.h is full) to
+//   have it sent again on the next run().
+// A stage only runs when the next one has room (backpressure): a message
+// that the sink refused holds back the next batch, a full batch holds the
+// samples in the ring and a full ring stops polling the source (or drops
+// what push() is given), so nothing grows and nothing is allocated.
+//
+// Every stage counts what it passed on, what it was held back by, what it
+// dropped and the time spent in it (pipeline_stage), e.g. the throughput of
+// a stage is items / elapsed time and its cost is busy_us / items.
+//
+// Depends on ring.h, uses millis() and micros() of the Arduino core. When
+// imported after "Dynamic Request Module" (request.h) or "Network Offload
+// Module" (offload.h), also defines PIPELINE_REQUEST_SINK.
+//
+// Defines the following for the user:
+// - pipeline<T, N, B, M>: Pipeline of samples of type T with a ring of N
+//   samples (a power of two), batches of B samples and messages of M bytes
+//   (default 256, including the terminating 0).
+//   - pipeline(source, encode, sink, window_ms): source may be NULL (samples
+//     come from push()), encode NULL for pipeline_csv<T>, window_ms 0 to
+//     only send full batches.
+//   - p.push(x): Queues sample x (when there is no source), false if full.
+//   - p.run(): Runs every stage once, call it from loop() or a task of
+//     scheduler.h.
+//   - p.flush(): Sends the partial batch and returns whether nothing is
+//     left (e.g. before sleeping).
+//   - p.source_stats, p.window_stats, p.encode_stats, p.sink_stats: Counters
+//     of the stages.
+// - pipeline_stage: items (samples or messages passed on), bytes (of the
+//   messages), stalls (runs held back by the next stage, or refused by the
+//   sink), dropped (samples lost) and busy_us.
+// - pipeline_csv<T>, pipeline_delta_csv<T>: Encoders, "v0,v1,..." and
+//   "v0,v1-v0,v2-v1,...".
+// - PIPELINE_REQUEST_SINK(variable_name, client): Defines the sink
+//   variable_name sending with REQUEST_SEND(client, ...) (offload_send when
+//   offload.h is imported).
+//
+// Example:
+// ```c
+// #include "network.h"
+// #include "request.h"
+// #include "ring.h"
+// #include "pipeline.h"
+//
+// NETWORK_INIT(network);
+// REQUEST_INIT(network, request);
+// PIPELINE_REQUEST_SINK(send, request);
+//
+// bool sample(int16_t &x) {
+//   x = analogRead(A0);
+//   return true;
+// }
+// // 64 samples per message, or what was sampled in the last 5 s
+// pipeline<int16_t, 128, 64> samples(sample, pipeline_delta_csv<int16_t>,
+//                                    send, 5000);
+//
+// void setup() {
+//   NETWORK_SETUP();
+//   REQUEST_SETUP(request);
+// }
+//
+// void loop() {
+//   samples.run();
+//   DBG(samples.sink_stats.items); // messages sent
+//   delay(10);
+// }
+// ```
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Dependecies
+#include "ring.h"
+
+// Counters
+struct pipeline_stage {
+  uint32_t items;   // samples (source, window) or messages (encode, sink)
+  uint32_t bytes;   // of the messages (encode, sink)
+  uint32_t stalls;  // runs held back by the next stage (or the sink failed)
+  uint32_t dropped; // samples lost
+  uint32_t busy_us;
+};
+
+// Helpers
+// Adds the time since start to the stage, returns now
+inline uint32_t _pipeline_lap(pipeline_stage &stage, uint32_t start) {
+  const uint32_t now = micros();
+  stage.busy_us += now - start;
+  return now;
+}
+
+// Same format as DBG of the number (no float support needed for integers)
+template <typename T> int _pipeline_format(char *out, size_t cap, T x) {
+  if (T(0.5) != T(0))
+    return snprintf(out, cap, "%g", (double)x);
+  if (T(-1) < T(0))
+    return snprintf(out, cap, "%ld", (long)x);
+  return snprintf(out, cap, "%lu", (unsigned long)x);
+}
+
+template <typename T>
+size_t _pipeline_list(const T *batch, size_t n, char *out, size_t cap,
+                      bool delta) {
+  size_t length = 0;
+  for (size_t i = 0; i < n; i++) {
+    const int written =
+        delta && i > 0
+            ? _pipeline_format(out + length, cap - length,
+                               (long)batch[i] - (long)batch[i - 1])
+            : _pipeline_format(out + length, cap - length, batch[i]);
+    if (written < 0 || (size_t)written + (i + 1 < n) >= cap - length)
+      return 0;
+    length += written;
+    if (i + 1 < n)
+      out[length++] = ',';
+  }
+  return length;
+}
+
+// Program
+template <typename T>
+size_t pipeline_csv(const T *batch, size_t n, char *out, size_t cap) {
+  return _pipeline_list(batch, n, out, cap, false);
+}
+
+template <typename T>
+size_t pipeline_delta_csv(const T *batch, size_t n, char *out, size_t cap) {
+  return _pipeline_list(batch, n, out, cap, true);
+}
+
+template <typename T, size_t N, size_t B, size_t M = 256> struct pipeline {
+  static_assert(B > 0 && M > 1, "pipeline needs a batch and a message");
+
+  bool (*source)(T &sample);
+  size_t (*encode)(const T *batch, size_t n, char *out, size_t cap);
+  bool (*sink)(const char *msg, size_t len);
+  uint32_t window_ms;
+
+  ring_spsc<T, N> input;
+  T batch[B];
+  size_t batched;
+  uint32_t batch_start; // ms of the first sample of the batch
+  char message[M];
+  size_t length; // of the message waiting for the sink, 0 if none
+
+  pipeline_stage source_stats, window_stats, encode_stats, sink_stats;
+
+  pipeline(bool (*source_fn)(T &),
+           size_t (*encode_fn)(const T *, size_t, char *, size_t),
+           bool (*sink_fn)(const char *, size_t), uint32_t window = 0)
+      : source(source_fn),
+        encode(encode_fn != NULL ? encode_fn : pipeline_csv<T>),
+        sink(sink_fn), window_ms(window), batched(0), batch_start(0),
+        length(0), source_stats(), window_stats(), encode_stats(),
+        sink_stats() {
+    input.clear();
+  }
+
+  bool push(const T &x) {
+    if (!input.push(x)) {
+      source_stats.dropped++;
+      return false;
+    }
+    source_stats.items++;
+    return true;
+  }
+
+  void run() {
+    if (source != NULL) {
+      const uint32_t start = micros();
+      T *slot = input.claim();
+      if (slot == NULL)
+        source_stats.stalls++;
+      else if (source(*slot)) {
+        input.publish();
+        source_stats.items++;
+      }
+      _pipeline_lap(source_stats, start);
+    }
+    _drain(false);
+  }
+
+  bool flush() {
+    _drain(true);
+    return batched == 0 && length == 0;
+  }
+
+  void _drain(bool flushing) {
+    uint32_t start = micros();
+    // window
+    for (T *s; batched < B && (s = input.peek()) != NULL; input.release()) {
+      if (batched == 0)
+        batch_start = millis();
+      batch[batched++] = *s;
+      window_stats.items++;
+    }
+    if (batched == B && !input.empty())
+      window_stats.stalls++;
+    const bool ready =
+        batched == B ||
+        (batched != 0 &&
+         (flushing ||
+          (window_ms != 0 && millis() - batch_start >= window_ms)));
+    start = _pipeline_lap(window_stats, start);
+
+    // encode
+    if (ready && length != 0)
+      encode_stats.stalls++;
+    else if (ready) {
+      length = encode(batch, batched, message, M);
+      if (length == 0 || length >= M) {
+        encode_stats.dropped += batched;
+        length = 0;
+      } else {
+        message[length] = '\0';
+        encode_stats.items++;
+        encode_stats.bytes += length;
+      }
+      batched = 0;
+    }
+    start = _pipeline_lap(encode_stats, start);
+
+    // sink
+    if (length != 0) {
+      if (sink(message, length)) {
+        sink_stats.items++;
+        sink_stats.bytes += length;
+        length = 0;
+      } else
+        sink_stats.stalls++;
+    }
+    _pipeline_lap(sink_stats, start);
+  }
+};
+
+#if defined(OFFLOAD_H_)
+#define _PIPELINE_SEND(client, msg, len) offload_send(msg, len)
+#elif defined(REQUEST_H_) && REQUEST_MODE == 0 // HTTP
+#define _PIPELINE_SEND(client, msg, len) REQUEST_SEND(client, String(msg))
+#elif defined(REQUEST_H_) // MQTT
+#define _PIPELINE_SEND(client, msg, len) client.publish(REQUEST_PATH, msg)
+#endif // OFFLOAD_H_
+
+#ifdef _PIPELINE_SEND
+#define PIPELINE_REQUEST_SINK(variable_name, client)                           \
+  bool variable_name(const char *msg, size_t len) {                            \
+    (void)len;                                                                 \
+    return _PIPELINE_SEND(client, msg, len);                                   \
+  }
+#endif // _PIPELINE_SEND
+
+#endif // PIPELINE_H_
@@ -159,59 +159,11 @@
 #if REQUEST_MODE == 0  // HTTP
 #define _HEADER_LEN 49 // The header line length of the response
 int _wait = 0;
-/* Make a request and return response header.
- *
- * Includes Host header in all requests and Content-Length to POST methods.
+/* Read the response available on client and close it.
  *
- * @param `method` must be in all caps.
- * @param NETWORK_CLIENT can either be EthernetClient or WiFiClient.
- * @returns 0 if request fails otherwise the http code.
+ * @returns 0 if there is no valid response otherwise the http code.
  */
-int http_request(String data, NETWORK_CLIENT &client, String method,
-                 String base_url, String path, int port,
-                 String additional_headers) {
-  const bool not_get = !method.equals("GET");
-
-  // Connect and make the request
-  if (!NETWORK_CONNECT(client, base_url.c_str(), port))
-    return 0;
-
-  // Format request
-  String request = "";
-  request.concat(method);
-  request.concat(" " + path);
-  request.concat(not_get ? "" : ("?" + data));
-  request.concat(" HTTP/1.1\n");
-  request.concat("Host: " + base_url + "\n");
-  if (not_get) {
-    request.concat("Content-Length: ");
-    request.concat(data.length());
-    request.concat("\n");
-  } // header end
-  if (additional_headers != "" && additional_headers != NULL)
-    request.concat(additional_headers);
-  // data
-  if (not_get)
-    request.concat("\n" + data);
-
-  DBG("Outgoing request:\n");
-  client.println(request);
-  DBG(request);
-  DBG("\n");
-  DBG("Outgoing request finished\n");
-
-  DBG("HTTP response:\n");
-  // Wait for the answer to come back just to be sure
-  // Prevents some "empty response" instances
-  while (client.available() == 0) {
-    delay(1);
-    if (_wait++ > REQUEST_REPLY_WAIT) {
-      DBG("Wait for network timed out\n");
-      _wait = 0;
-      break;
-    }
-  }
-
+int _http_read_response(NETWORK_CLIENT &client) {
   // Save the response header
   char header_str[_HEADER_LEN + 1];
   byte header_str_i = 0;
@@ -251,6 +203,96 @@ int http_request(String data, NETWORK_CLIENT &client, String method,
   DBG("\n");
   return possible_code;
 }
+
+/* Wait for the response of a request sent on client, read and close it.
+ *
+ * @returns 0 if there is no valid response otherwise the http code.
+ */
+int _http_response(NETWORK_CLIENT &client) {
+  DBG("HTTP response:\n");
+  // Wait for the answer to come back just to be sure
+  // Prevents some "empty response" instances
+  while (client.available() == 0) {
+    delay(1);
+    if (_wait++ > REQUEST_REPLY_WAIT) {
+      DBG("Wait for network timed out\n");
+      _wait = 0;
+      break;
+    }
+  }
+  return _http_read_response(client);
+}
+
+/* Format the request line and the headers of a request, every line ends
+ * with a newline and the empty line ending the header is left to the caller.
+ *
+ * @param `content_type` is left out when empty.
+ * @param `content_length` is left out when negative.
+ */
+String _http_head(String method, String base_url, String path,
+                  String additional_headers, String content_type,
+                  long content_length) {
+  String head = "";
+  head.concat(method);
+  head.concat(" " + path + " HTTP/1.1\n");
+  head.concat("Host: " + base_url + "\n");
+  if (content_type != "" && content_type != NULL)
+    head.concat("Content-Type: " + content_type + "\n");
+  if (content_length >= 0) {
+    head.concat("Content-Length: ");
+    head.concat(content_length);
+    head.concat("\n");
+  }
+  if (additional_headers != "" && additional_headers != NULL)
+    head.concat(additional_headers + "\n");
+  return head;
+}
+
+/* Connect and send a request without waiting for its response.
+ *
+ * @returns false if the connection fails.
+ */
+bool _http_send(String data, NETWORK_CLIENT &client, String method,
+                String base_url, String path, int port,
+                String additional_headers) {
+  const bool not_get = !method.equals("GET");
+
+  // Connect and make the request
+  if (!NETWORK_CONNECT(client, base_url.c_str(), port))
+    return false;
+
+  // Format request, println ends the header of GET requests
+  String request =
+      _http_head(method, base_url, not_get ? path : path + "?" + data,
+                 additional_headers, "", not_get ? (long)data.length() : -1);
+  // data
+  if (not_get)
+    request.concat("\n" + data);
+
+  DBG("Outgoing request:\n");
+  client.println(request);
+  DBG(request);
+  DBG("\n");
+  DBG("Outgoing request finished\n");
+  return true;
+}
+
+/* Make a request and return response header.
+ *
+ * Includes Host header in all requests and Content-Length to POST methods.
+ *
+ * @param `method` must be in all caps.
+ * @param NETWORK_CLIENT can either be EthernetClient or WiFiClient.
+ * @returns 0 if request fails otherwise the http code.
+ */
+int http_request(String data, NETWORK_CLIENT &client, String method,
+                 String base_url, String path, int port,
+                 String additional_headers) {
+  if (!_http_send(data, client, method, base_url, path, port,
+                  additional_headers))
+    return 0;
+  return _http_response(client);
+}
 #define REQUEST_INIT(net_client, variable_name) /* just to suppress errors */  \
   NETWORK_CLIENT *variable_name = &net_client;
 #define REQUEST_SETUP(client)
@@ -0,0 +1,223 @@
+// Lock-free Ring Module
+//
+// Bounded queues of N elements of type T to hand data from where it is made
+// (an interrupt, a sampling task, the other core) to where it is used (the
+// loop, a network task) without locks or disabling interrupts:
+// - ring_spsc<T, N>: One producer and one consumer. head is only written by
+//   the producer and tail by the consumer, so a push and a pop are a load, a
+//   copy and a store each. Elements can also be filled and read in place
+//   (claim/publish, peek/release) to avoid a copy of large elements.
+// - ring_mpsc<T, N>: Any number of producers (e.g. several interrupts or
+//   tasks on both cores) and one consumer. Producers take a slot with a
+//   compare-and-swap on head and mark it written with a sequence number per
+//   slot, so a producer interrupted in the middle of a push only holds back
+//   the consumer (never the other producers). Needs compare-and-swap (ESP32,
+//   ARM Cortex-M3 and up, hosts).
+//
+// N is a power of two and all N slots are usable (the indices run freely and
+// wrap around). head, tail and the slots are on separate cache lines, so the
+// producer and the consumer on two cores do not keep taking the same line
+// from each other (false sharing). The element is written before the
+// release store that publishes it and read after the acquire load that sees
+// it (and the other way around for giving the slot back), which is what both
+// interrupt to loop (one core) and core to core handoff need.
+//
+// Define macroes below before importing the header to configure:
+// ```c
+// #define RING_CACHE_LINE 64 // optional, bytes of a cache line (default 32
+//                            // on ESP32, 64 otherwise)
+// ```
+//
+// The methods are small and inline so they can be called from an ISR (which
+// should be in IRAM on ESP32 together with the ring's element copies).
+//
+// Defines the following for the user:
+// - ring_spsc<T, N>: SPSC ring (zero initialized as a global).
+//   - r.push(x): Copies x in, returns false if full.
+//   - r.pop(x): Copies the oldest element into x, returns false if empty.
+//   - r.claim(): Producer, the free slot to fill in place (NULL if full).
+//   - r.publish(): Producer, makes the claimed slot available.
+//   - r.peek(): Consumer, the oldest element in place (NULL if empty).
+//   - r.release(): Consumer, gives the peeked slot back.
+// - ring_mpsc<T, N>: MPSC ring (zero initialized as a global, N >= 2).
+//   - r.push(x), r.pop(x), r.peek(), r.release(): Same as ring_spsc.
+// - r.size(), r.empty(), r.full() (approximate while the other side runs),
+//   r.clear() (when neither side runs), RING_CAPACITY(r).
+//
+// Example:
+// ```c
+// #include "ring.h"
+//
+// struct sample {
+//   uint32_t us;
+//   uint16_t value;
+// };
+// ring_spsc<sample, 64> samples; // ISR -> loop
+// struct line {
+//   char text[48];
+// };
+// ring_mpsc<line, 16> logs; // any task -> loop
+//
+// void IRAM_ATTR on_ready() {
+//   sample s = {micros(), (uint16_t)analogRead(A0)};
+//   samples.push(s); // dropped if the loop is too slow
+// }
+//
+// void setup() {
+//   attachInterrupt(digitalPinToInterrupt(4), on_ready, RISING);
+// }
+//
+// void loop() {
+//   sample s;
+//   while (samples.pop(s))
+//     DBG(s.value);
+//   while (const line *l = logs.peek()) {
+//     DBG(l->text);
+//     logs.release();
+//   }
+// }
+// ```
+
+#ifndef RING_H_
+#define RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Defaults
+#ifndef RING_CACHE_LINE
+#if defined(ESP32)
+#define RING_CACHE_LINE 32
+#else
+#define RING_CACHE_LINE 64
+#endif // ESP32
+#endif // RING_CACHE_LINE
+
+#define RING_CAPACITY(r) (sizeof((r).slots) / sizeof((r).slots[0]))
+
+// Program
+template <typename T, size_t N> struct ring_spsc {
+  static_assert(N > 0 && (N & (N - 1)) == 0,
+                "ring_spsc needs a power of two capacity");
+
+  alignas(RING_CACHE_LINE) uint32_t head; // next slot to write, producer
+  alignas(RING_CACHE_LINE) uint32_t tail; // next slot to read, consumer
+  alignas(RING_CACHE_LINE) T slots[N];
+
+  // Producer
+  T *claim() {
+    const uint32_t h = head;
+    return h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == N
+               ? NULL
+               : &slots[h & (N - 1)];
+  }
+  void publish() { __atomic_store_n(&head, head + 1, __ATOMIC_RELEASE); }
+  bool push(const T &x) {
+    T *slot = claim();
+    if (slot == NULL)
+      return false;
+    *slot = x;
+    publish();
+    return true;
+  }
+
+  // Consumer
+  T *peek() {
+    const uint32_t t = tail;
+    return __atomic_load_n(&head, __ATOMIC_ACQUIRE) == t ? NULL
+                                                         : &slots[t & (N - 1)];
+  }
+  void release() { __atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE); }
+  bool pop(T &x) {
+    T *slot = peek();
+    if (slot == NULL)
+      return false;
+    x = *slot;
+    release();
+    return true;
+  }
+
+  uint32_t size() const {
+    return __atomic_load_n(&head, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+  }
+  bool empty() const { return size() == 0; }
+  bool full() const { return size() == N; }
+  void clear() { head = tail = 0; }
+};
+
+template <typename T, size_t N> struct ring_mpsc {
+  static_assert(N > 1 && (N & (N - 1)) == 0,
+                "ring_mpsc needs a power of two capacity of 2 or more");
+
+  // Index i goes to slot i % N, which is free for its push when seq is the
+  // start of its lap (i - i % N), written when it is one more and free again
+  // for the next lap once the consumer sets it to the next start. So a zeroed
+  // ring is empty.
+  struct slot_type {
+    uint32_t seq;
+    T value;
+  };
+  static uint32_t lap(uint32_t i) { return i & ~(uint32_t)(N - 1); }
+
+  alignas(RING_CACHE_LINE) uint32_t head; // next index to claim, producers
+  alignas(RING_CACHE_LINE) uint32_t tail; // next index to read, consumer
+  alignas(RING_CACHE_LINE) slot_type slots[N];
+
+  // Producers
+  bool push(const T &x) {
+    uint32_t h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    for (;;) {
+      slot_type &s = slots[h & (N - 1)];
+      const int32_t diff =
+          (int32_t)(__atomic_load_n(&s.seq, __ATOMIC_ACQUIRE) - lap(h));
+      if (diff < 0) // not given back by the consumer yet
+        return false;
+      if (diff > 0) { // taken by another producer, h is stale
+        h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        continue;
+      }
+      if (__atomic_compare_exchange_n(&head, &h, h + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        s.value = x;
+        __atomic_store_n(&s.seq, lap(h) + 1, __ATOMIC_RELEASE);
+        return true;
+      }
+    }
+  }
+
+  // Consumer
+  T *peek() {
+    slot_type &s = slots[tail & (N - 1)];
+    return __atomic_load_n(&s.seq, __ATOMIC_ACQUIRE) == lap(tail) + 1 ? &s.value
+                                                                      : NULL;
+  }
+  void release() {
+    __atomic_store_n(&slots[tail & (N - 1)].seq, lap(tail) + (uint32_t)N,
+                     __ATOMIC_RELEASE);
+    __atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE);
+  }
+  bool pop(T &x) {
+    T *value = peek();
+    if (value == NULL)
+      return false;
+    x = *value;
+    release();
+    return true;
+  }
+
+  // Counts the slots being written by a producer too
+  uint32_t size() const {
+    return __atomic_load_n(&head, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+  }
+  bool empty() const { return size() == 0; }
+  bool full() const { return size() == N; }
+  void clear() {
+    head = tail = 0;
+    for (size_t i = 0; i < N; i++)
+      slots[i].seq = 0;
+  }
+};
+
+#endif // RING_H_
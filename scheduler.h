@@ -0,0 +1,295 @@
+// Cooperative Scheduler Module
+//
+// Runs periodic and one-shot tasks from loop() instead of a loop() full of
+// delay(): every task is a plain function which runs to completion, and
+// scheduler_run() calls the ones that are due. While one task waits for its
+// next period the others (sampling, NETWORK_LOOP, REQUEST_LOOP, ...) keep
+// running, so a sampling deadline is only missed by the time of the longest
+// task instead of by a whole delay().
+//
+// Tasks are kept in a hashed timer wheel: SCHEDULER_WHEEL_SIZE slots of
+// SCHEDULER_TICK_MS each, a task waits in the slot of its deadline (modulo the
+// size of the wheel) and scheduler_run() only looks at the slots of the ticks
+// that passed since its last call. Adding, running and rescheduling a task
+// does not depend on the number of tasks. Tasks are structs owned by the
+// sketch (usually globals), so nothing is allocated.
+//
+// When a call of scheduler_run() finds nothing due, it calls the idle hooks
+// with the number of ms until the next deadline (e.g. to sleep or do
+// background work). The time spent in tasks is measured so the load (and so
+// the idle time) of the loop can be printed.
+//
+// Define macroes below before importing the header to configure:
+// ```c
+// #define SCHEDULER_TICK_MS 1     // optional, resolution of the deadlines,
+//                                 // tasks run up to a tick late (default 1)
+// #define SCHEDULER_WHEEL_SIZE 32 // optional, slots of the wheel, a power of
+//                                 // two (default 32)
+// #define SCHEDULER_IDLE_HOOKS 2  // optional, number of idle hooks
+//                                 // (default 2)
+// ```
+//
+// Uses millis() and micros() of the Arduino core.
+//
+// Defines the following for the user:
+// - SCHEDULER_TASK(variable_name, fn): Defines the task variable_name running
+//   `void fn()`.
+// - scheduler_every(task, period_ms, delay_ms): Runs task every period_ms ms
+//   starting delay_ms ms from now (default 0). Deadlines follow each other by
+//   exactly period_ms ms (no drift) unless a whole period is missed.
+// - scheduler_after(task, delay_ms): Runs task once delay_ms ms from now.
+// - scheduler_cancel(task): Unschedules task.
+// - scheduler_run(): Runs the due tasks, call it from loop().
+// - scheduler_delay(ms): delay() that keeps running the tasks (a plain
+//   delay() when called from a task).
+// - scheduler_on_idle(hook): Adds `void hook(uint32_t ms_to_next_task)` to the
+//   idle hooks, returns false if there is no room.
+// - scheduler_load(): Percent of the time spent in tasks since the previous
+//   call (100 minus the idle time).
+// - task.runs, task.busy_us, task.late_ms: Number of runs, total run time and
+//   the largest delay between a deadline and the start of the run.
+//
+// When imported after "Dynamic Networking Module" (network.h) and "Dynamic
+// Request Module" (request.h), also defines:
+// - SCHEDULER_NETWORK_TASK(variable_name): Task running NETWORK_LOOP().
+// - SCHEDULER_REQUEST_TASK(client, variable_name): Task running
+//   REQUEST_LOOP(client).
+// Note that these still block while the connection is being re-established
+// (NETWORK_SETUP and REQUEST_SETUP loop until they connect).
+//
+// Example:
+// ```c
+// #include "network.h"
+// #include "request.h"
+// #include "scheduler.h"
+//
+// NETWORK_INIT(network);
+// REQUEST_INIT(network, request);
+// SCHEDULER_NETWORK_TASK(network_task);
+// SCHEDULER_REQUEST_TASK(request, request_task);
+//
+// int samples[100];
+// size_t sampled = 0;
+// void sample() { samples[sampled++ % 100] = analogRead(A0); }
+// void report() {
+//   String data = String(samples[0]);
+//   REQUEST_SEND(request, data);
+//   DBG("Load: ");
+//   DBG(scheduler_load());
+//   DBG("%\n");
+// }
+// SCHEDULER_TASK(sample_task, sample);
+// SCHEDULER_TASK(report_task, report);
+//
+// void setup() {
+//   NETWORK_SETUP();
+//   REQUEST_SETUP(request);
+//   scheduler_every(sample_task, 10); // 100 Hz
+//   scheduler_every(report_task, 3000);
+//   scheduler_every(network_task, 1000);
+//   scheduler_every(request_task, 100);
+// }
+//
+// void loop() { scheduler_run(); }
+// ```
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+
+// Defaults
+#ifndef SCHEDULER_TICK_MS
+#define SCHEDULER_TICK_MS 1
+#endif // SCHEDULER_TICK_MS
+
+#ifndef SCHEDULER_WHEEL_SIZE
+#define SCHEDULER_WHEEL_SIZE 32
+#endif // SCHEDULER_WHEEL_SIZE
+
+#ifndef SCHEDULER_IDLE_HOOKS
+#define SCHEDULER_IDLE_HOOKS 2
+#endif // SCHEDULER_IDLE_HOOKS
+
+#if (SCHEDULER_WHEEL_SIZE & (SCHEDULER_WHEEL_SIZE - 1)) != 0
+#error "SCHEDULER_WHEEL_SIZE must be a power of two"
+#endif // SCHEDULER_WHEEL_SIZE
+
+// Tasks
+struct scheduler_task {
+  void (*fn)();
+  uint32_t due;         // ms
+  uint32_t period;      // ms, 0 for one-shot tasks
+  scheduler_task *next; // in the same slot of the wheel
+  bool scheduled;
+  uint32_t runs, busy_us, late_ms;
+};
+
+// Helpers
+scheduler_task *_scheduler_wheel[SCHEDULER_WHEEL_SIZE];
+uint32_t _scheduler_tick = 0; // last tick whose slot was run
+bool _scheduler_running = false;
+void (*_scheduler_idle[SCHEDULER_IDLE_HOOKS])(uint32_t);
+uint32_t _scheduler_busy_us = 0, _scheduler_load_busy_us = 0,
+         _scheduler_load_us = 0;
+
+// Tick whose slot holds a deadline: the first one starting at or after it,
+// as the slot of a tick is run as soon as the tick starts
+uint32_t _scheduler_due_tick(uint32_t due) {
+  return (due + SCHEDULER_TICK_MS - 1) / SCHEDULER_TICK_MS;
+}
+
+void _scheduler_insert(scheduler_task &task) {
+  // A deadline of a slot that was already run waits in the next one
+  uint32_t tick = _scheduler_due_tick(task.due);
+  if ((int32_t)(tick - _scheduler_tick) <= 0)
+    tick = _scheduler_tick + 1;
+  scheduler_task *&slot = _scheduler_wheel[tick & (SCHEDULER_WHEEL_SIZE - 1)];
+  task.next = slot;
+  slot = &task;
+  task.scheduled = true;
+}
+
+// Runs the due tasks of the slot of tick, returns whether any ran
+bool _scheduler_run_slot(uint32_t tick, uint32_t now) {
+  bool ran = false;
+  scheduler_task **p = &_scheduler_wheel[tick & (SCHEDULER_WHEEL_SIZE - 1)];
+  while (*p != NULL) {
+    scheduler_task &task = **p;
+    if ((int32_t)(now - task.due) < 0) {
+      p = &task.next;
+      continue;
+    }
+    *p = task.next;
+    task.scheduled = false;
+    const uint32_t late = now - task.due;
+    task.late_ms = late > task.late_ms ? late : task.late_ms;
+    if (task.period != 0) {
+      task.due += task.period;
+      if ((int32_t)(now - task.due) >= 0) // missed a whole period
+        task.due = now + task.period;
+      _scheduler_insert(task);
+    }
+    const uint32_t start = micros();
+    task.fn();
+    const uint32_t spent = micros() - start;
+    task.runs++;
+    task.busy_us += spent;
+    _scheduler_busy_us += spent;
+    ran = true;
+  }
+  return ran;
+}
+
+// Time until the earliest deadline (SCHEDULER_WHEEL_SIZE ticks at most)
+uint32_t _scheduler_next_ms(uint32_t now) {
+  uint32_t next = SCHEDULER_WHEEL_SIZE * SCHEDULER_TICK_MS;
+  for (uint32_t i = 0; i < SCHEDULER_WHEEL_SIZE; i++)
+    for (scheduler_task *t = _scheduler_wheel[i]; t != NULL; t = t->next) {
+      const int32_t left = (int32_t)(t->due - now);
+      next = left <= 0 ? 0 : ((uint32_t)left < next ? (uint32_t)left : next);
+    }
+  return next;
+}
+
+// Program
+void scheduler_cancel(scheduler_task &task) {
+  if (!task.scheduled)
+    return;
+  const uint32_t tick = _scheduler_due_tick(task.due);
+  // Look in the slot of the deadline first, it can only be in another one if
+  // it was due when it was inserted
+  for (uint32_t i = 0; i <= SCHEDULER_WHEEL_SIZE; i++) {
+    const uint32_t slot = (i == 0 ? tick : i - 1) & (SCHEDULER_WHEEL_SIZE - 1);
+    for (scheduler_task **p = &_scheduler_wheel[slot]; *p != NULL;
+         p = &(*p)->next)
+      if (*p == &task) {
+        *p = task.next;
+        task.scheduled = false;
+        return;
+      }
+  }
+}
+
+void scheduler_every(scheduler_task &task, uint32_t period_ms,
+                     uint32_t delay_ms = 0) {
+  scheduler_cancel(task);
+  task.period = period_ms;
+  task.due = millis() + delay_ms;
+  _scheduler_insert(task);
+}
+
+void scheduler_after(scheduler_task &task, uint32_t delay_ms) {
+  scheduler_every(task, 0, delay_ms);
+}
+
+void scheduler_run() {
+  const uint32_t now = millis(), tick = now / SCHEDULER_TICK_MS;
+  _scheduler_running = true;
+  bool ran = false;
+  // Every slot at most once, even if the last call was long ago
+  uint32_t ticks = tick - _scheduler_tick;
+  if (ticks > SCHEDULER_WHEEL_SIZE)
+    _scheduler_tick = tick - SCHEDULER_WHEEL_SIZE;
+  while (_scheduler_tick != tick)
+    ran |= _scheduler_run_slot(++_scheduler_tick, now);
+  _scheduler_running = false;
+  if (ran)
+    return;
+  bool hooked = false;
+  for (size_t i = 0; i < SCHEDULER_IDLE_HOOKS; i++)
+    hooked |= _scheduler_idle[i] != NULL;
+  if (!hooked)
+    return;
+  const uint32_t next = _scheduler_next_ms(now);
+  for (size_t i = 0; i < SCHEDULER_IDLE_HOOKS; i++)
+    if (_scheduler_idle[i] != NULL)
+      _scheduler_idle[i](next);
+}
+
+void scheduler_delay(uint32_t ms) {
+  if (_scheduler_running) {
+    delay(ms);
+    return;
+  }
+  const uint32_t start = millis();
+  while (millis() - start < ms)
+    scheduler_run();
+}
+
+bool scheduler_on_idle(void (*hook)(uint32_t)) {
+  for (size_t i = 0; i < SCHEDULER_IDLE_HOOKS; i++)
+    if (_scheduler_idle[i] == NULL) {
+      _scheduler_idle[i] = hook;
+      return true;
+    }
+  return false;
+}
+
+uint8_t scheduler_load() {
+  const uint32_t now = micros(), busy = _scheduler_busy_us;
+  const uint32_t elapsed = now - _scheduler_load_us,
+                 spent = busy - _scheduler_load_busy_us;
+  _scheduler_load_us = now;
+  _scheduler_load_busy_us = busy;
+  return elapsed == 0 || spent >= elapsed
+             ? 100
+             : (uint8_t)((uint64_t)spent * 100 / elapsed);
+}
+
+#define SCHEDULER_TASK(variable_name, fn)                                      \
+  scheduler_task variable_name = {fn, 0, 0, NULL, false, 0, 0, 0}
+
+#ifdef NETWORK_H_
+#define SCHEDULER_NETWORK_TASK(variable_name)                                  \
+  void variable_name##_fn() { NETWORK_LOOP(); }                                \
+  SCHEDULER_TASK(variable_name, variable_name##_fn)
+#endif // NETWORK_H_
+
+#ifdef REQUEST_H_
+#define SCHEDULER_REQUEST_TASK(client, variable_name)                          \
+  void variable_name##_fn() { REQUEST_LOOP(client); }                          \
+  SCHEDULER_TASK(variable_name, variable_name##_fn)
+#endif // REQUEST_H_
+
+#endif // SCHEDULER_H_